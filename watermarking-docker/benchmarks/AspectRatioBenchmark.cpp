@@ -0,0 +1,115 @@
+// The native forward transform over the whole image against the pruned one
+// that computes only the p x p watermark block mark extraction reads, for
+// common aspect ratios, with how far the pruned block is from the full
+// transform's.
+//   AspectRatioBenchmark [--runs n] [--float] [--opencv] [rowsxcols ...]
+// --opencv also times cv::dft's full transform for comparison.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/Utilities.hpp"
+
+namespace {
+
+struct Shape {
+  const char* aspect;
+  int rows;
+  int cols;
+};
+
+const Shape kShapes[] = {{"4:3", 3000, 4000},
+                         {"16:9", 2160, 3840},
+                         {"3:2", 2000, 3000},
+                         {"4:1", 1500, 6000},
+                         {"8:1", 1000, 8000}};
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// the fastest of runs transforms of a fresh copy of input (the transforms
+// are in place), with the last result
+template <typename Transform>
+double fastest(int runs, const cv::Mat& input, Transform transform) {
+  double best = 1e30;
+  for (int r = 0; r < runs; r++) {
+    cv::Mat mat = input.clone();
+    auto start = std::chrono::high_resolution_clock::now();
+    transform(mat);
+    best = std::min(best, millisecondsSince(start));
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int runs = 3, depth = CV_64F;
+  bool withOpencv = false;
+  std::vector<Shape> shapes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    int rows, cols;
+    if (arg == "--runs" && i + 1 < argc && parseNumber(argv[i + 1], runs) && runs > 0) {
+      i++;
+    } else if (arg == "--float") {
+      depth = CV_32F;
+    } else if (arg == "--opencv") {
+      withOpencv = true;
+    } else if (sscanf(argv[i], "%dx%d", &rows, &cols) == 2 && rows > 3 && cols > 3) {
+      Shape shape = {"", rows, cols};
+      shapes.push_back(shape);
+    } else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (shapes.empty()) shapes.assign(std::begin(kShapes), std::end(kShapes));
+
+  cv::setRNGSeed(1);
+  printf("native forward transform, %s, best of %d\n", depth == CV_64F ? "double" : "float",
+         runs);
+  printf("%5s  %11s  %5s  %10s  %10s  %7s  %10s  %s\n", "", "size", "p", "full ms", "block ms",
+         "speedup", "opencv ms", "error");
+  for (const Shape& shape : shapes) {
+    cv::Mat input(shape.rows, shape.cols, depth);
+    cv::randu(input, 0.0, 1.0);
+    int p = largestPrimeFor(shape.rows, shape.cols);
+    cv::Mat block(p, p, depth);
+
+    setFftBackend("native");
+    std::shared_ptr<const FftPlan> plan = fftPlan(shape.rows, shape.cols, depth, false);
+    cv::Mat full;
+    double fullTime = fastest(runs, input, [&](cv::Mat& mat) {
+      plan->execute(mat);
+      full = mat;
+    });
+    double blockTime = fastest(runs, input, [&](cv::Mat& mat) { plan->executeBlock(mat, block); });
+    cv::Mat expected = full(cv::Rect(1, 1, p, p)).clone();
+    double error = cv::norm(block, expected, cv::NORM_INF) / cv::norm(expected, cv::NORM_INF);
+
+    double opencvTime = 0;
+    if (withOpencv) {
+      setFftBackend("opencv");
+      std::shared_ptr<const FftPlan> opencvPlan =
+          fftPlan(shape.rows, shape.cols, depth, false);
+      opencvTime = fastest(runs, input, [&](cv::Mat& mat) { opencvPlan->execute(mat); });
+    }
+
+    printf("%5s  %5dx%-5d  %5d  %10.1f  %10.1f  %6.2fx  ", shape.aspect, shape.rows, shape.cols,
+           p, fullTime, blockTime, fullTime / blockTime);
+    if (withOpencv)
+      printf("%10.1f  %.1g\n", opencvTime, error);
+    else
+      printf("%10s  %.1g\n", "-", error);
+  }
+  return 0;
+}
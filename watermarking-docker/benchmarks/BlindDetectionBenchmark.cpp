@@ -0,0 +1,288 @@
+// Blind detection (detect-wm --blind) against informed detection on the same
+// marked images: each message family's peak-to-RMS and whether the message
+// decodes, at each strength. Unmarked images, detected blind, give the null
+// distribution the blind threshold is set from: their families' peaks, and
+// the share of all their correlation values past 4 and 5 RMS, against the
+// normal model of FalsePositive.
+//   BlindDetectionBenchmark [--images n] [--size rowsxcols] [--texture sigma]
+//                           [--noise sigma] [--families n] [--message text]
+//                           [image ...]
+// Without image files, n synthetic hosts are generated: several octaves of
+// smooth noise (amplitude growing with scale, like a photograph's falling
+// spectrum) with hard-edged shapes over them. They lack a photograph's fine
+// detail and sensor noise, which --texture adds as Gaussian noise of sigma
+// levels, part of the host (so informed detection subtracts it and blind
+// detection can't). --noise adds Gaussian noise of sigma levels to every
+// detected image, as a capture would.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "watermarking-functions/FalsePositive.hpp"
+#include "watermarking-functions/LegendreSpectrum.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+#include "watermarking-functions/MarkCorrelator.hpp"
+#include "watermarking-functions/Utilities.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+#include "watermarking-functions/WatermarkPattern.hpp"
+
+namespace {
+
+// as detect-wm
+const int kWhiteningRadius = 4;
+const double kInformedThreshold = 6.0;
+
+const int kStrengths[] = {1, 2, 5, 10, 20};
+
+// a family's correlation with an extracted mark
+struct Peak {
+  double peak2rms;
+  int shift;
+  long beyond4;  // correlation values past 4 and 5 RMS
+  long beyond5;
+};
+
+// bilinear sample of a coarse grid at (y, x) in cells
+double sample(const cv::Mat& grid, double y, double x) {
+  int y0 = (int)y, x0 = (int)x;
+  double fy = y - y0, fx = x - x0;
+  const double* row0 = grid.ptr<double>(y0);
+  const double* row1 = grid.ptr<double>(y0 + 1);
+  return (1 - fy) * ((1 - fx) * row0[x0] + fx * row0[x0 + 1]) +
+         fy * ((1 - fx) * row1[x0] + fx * row1[x0 + 1]);
+}
+
+cv::Mat syntheticHost(std::mt19937& random, int rows, int cols) {
+  std::uniform_real_distribution<double> unit(-1.0, 1.0);
+  cv::Mat host = cv::Mat::zeros(rows, cols, CV_64F);
+  for (int cell = 256; cell >= 2; cell /= 2) {
+    cv::Mat grid(rows / cell + 2, cols / cell + 2, CV_64F);
+    for (int y = 0; y < grid.rows; y++)
+      for (int x = 0; x < grid.cols; x++) grid.at<double>(y, x) = unit(random) * cell;
+    for (int y = 0; y < rows; y++) {
+      double* row = host.ptr<double>(y);
+      for (int x = 0; x < cols; x++) row[x] += sample(grid, (double)y / cell, (double)x / cell);
+    }
+  }
+
+  // scale to a photograph's range, then paint flat shapes over it
+  cv::Scalar mean, deviation;
+  cv::meanStdDev(host, mean, deviation);
+  cv::Mat plane(rows, cols, CV_8U);
+  for (int y = 0; y < rows; y++)
+    for (int x = 0; x < cols; x++)
+      plane.at<uchar>(y, x) =
+          cv::saturate_cast<uchar>(128 + 45 * (host.at<double>(y, x) - mean[0]) / deviation[0]);
+  for (int i = 0; i < 6; i++) {
+    int x = (int)((unit(random) + 1) / 2 * cols), y = (int)((unit(random) + 1) / 2 * rows);
+    int width = (int)((unit(random) + 1.2) / 4 * cols);
+    int height = (int)((unit(random) + 1.2) / 4 * rows);
+    cv::Rect shape = cv::Rect(x, y, width, height) & cv::Rect(0, 0, cols, rows);
+    if (shape.area() > 0) plane(shape).setTo(cv::Scalar(128 + 120 * unit(random)));
+  }
+  return plane;
+}
+
+cv::Mat withNoise(std::mt19937& random, const cv::Mat& plane, double sigma) {
+  if (sigma <= 0) return plane;
+  std::normal_distribution<double> noise(0.0, sigma);
+  cv::Mat noisy(plane.size(), CV_8U);
+  for (int y = 0; y < plane.rows; y++)
+    for (int x = 0; x < plane.cols; x++)
+      noisy.at<uchar>(y, x) = cv::saturate_cast<uchar>(plane.at<uchar>(y, x) + noise(random));
+  return noisy;
+}
+
+// the extracted mark of marked less original, or of marked alone whitened
+// (original empty) as detect-wm extracts it
+std::vector<double> extracted(const cv::Mat& marked, const cv::Mat& original, int p) {
+  cv::Mat luma(marked.size(), CV_64F);
+  if (original.empty())
+    planeToLuma(marked, luma.ptr<double>(0));
+  else
+    planeDifferenceToLuma(marked, original, luma.ptr<double>(0));
+  std::vector<double> mark(p * p);
+  extractMark(LumaView<double>(luma), LumaView<double>(mark.data(), p, p));
+  if (original.empty()) whitenMark(p, mark.data(), kWhiteningRadius);
+  return mark;
+}
+
+Peak correlateFamily(int p, int k, const LegendreSpectrum& legendre,
+                     MarkCorrelator<double>& correlator) {
+  cv::Mat spectrum;
+  std::vector<double> correlation(p * p);
+  legendre.spectrumFor(k, spectrum);
+  correlator.correlateSpectrum(spectrum, correlation.data());
+
+  int peak = 0;
+  double ms = 0;
+  for (int i = 0; i < p * p; i++) {
+    if (correlation[i] > correlation[peak]) peak = i;
+    ms += correlation[i] * correlation[i] / ((double)p * p);
+  }
+  Peak result = {correlation[peak] / std::sqrt(ms), peak, 0, 0};
+  for (int i = 0; i < p * p; i++) {
+    double z = std::fabs(correlation[i]) / std::sqrt(ms);
+    result.beyond4 += z > 4;
+    result.beyond5 += z > 5;
+  }
+  return result;
+}
+
+// the weakest family's peak-to-RMS, and whether every family found its shift
+void detectMessage(const std::vector<double>& mark, int p, const std::vector<int>& shifts,
+                   const LegendreSpectrum& legendre, double& weakest, bool& decoded) {
+  MarkCorrelator<double> correlator(p, p, mark.data());
+  weakest = 1e30;
+  decoded = true;
+  for (size_t i = 0; i < shifts.size(); i++) {
+    Peak peak = correlateFamily(p, (int)i + 1, legendre, correlator);
+    weakest = std::min(weakest, peak.peak2rms);
+    decoded = decoded && peak.shift == shifts[i];
+  }
+}
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values.empty() ? 0 : values[values.size() / 2];
+}
+
+// the images whose message decoded above threshold
+int passing(const std::vector<double>& weakest, double threshold) {
+  int count = 0;
+  for (double peak2rms : weakest) count += peak2rms > threshold;
+  return count;
+}
+
+// the upper tail of a standard normal, both sides
+double twoSidedTail(double z) {
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int images = 16, rows = 480, cols = 640, families = 8;
+  double texture = 0, noise = 0;
+  std::string message = "Hi there";
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--images" && i + 1 < argc && parseNumber(argv[i + 1], images) && images > 0) {
+      i++;
+    } else if (arg == "--size" && i + 1 < argc &&
+               sscanf(argv[i + 1], "%dx%d", &rows, &cols) == 2 && rows > 8 && cols > 8) {
+      i++;
+    } else if (arg == "--texture" && i + 1 < argc && parseNumber(argv[i + 1], texture)) {
+      i++;
+    } else if (arg == "--noise" && i + 1 < argc && parseNumber(argv[i + 1], noise)) {
+      i++;
+    } else if (arg == "--families" && i + 1 < argc && parseNumber(argv[i + 1], families) &&
+               families > 0) {
+      i++;
+    } else if (arg == "--message" && i + 1 < argc) {
+      message = argv[++i];
+    } else if (arg.compare(0, 2, "--") != 0) {
+      files.push_back(arg);
+    } else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (!files.empty()) images = (int)files.size();
+
+  std::mt19937 random(18);
+  const int strengthCount = sizeof(kStrengths) / sizeof(kStrengths[0]);
+  // the weakest family of each image, 0 when a shift was wrong
+  std::vector<std::vector<double> > informed(strengthCount), blind(strengthCount);
+  std::vector<double> nullPeaks;
+  double beyond4 = 0, beyond5 = 0, values = 0, pSum = 0;
+
+  for (int image = 0; image < images; image++) {
+    cv::Mat host;
+    if (files.empty()) {
+      host = withNoise(random, syntheticHost(random, rows, cols), texture);
+    } else {
+      cv::Mat bgr = cv::imread(files[image], cv::IMREAD_COLOR);
+      if (bgr.empty()) {
+        fprintf(stderr, "unable to read %s\n", files[image].c_str());
+        return 1;
+      }
+      extractValue(bgr, host);
+    }
+    int p = largestPrimeFor(host.rows, host.cols);
+    LegendreSpectrum legendre(p);
+    std::vector<int> shifts = getShifts(message, p * p);
+    pSum += p;
+
+    // unmarked, blind: every family is a draw from the null
+    std::vector<double> nullMark = extracted(withNoise(random, host, noise), cv::Mat(), p);
+    MarkCorrelator<double> nullCorrelator(p, p, nullMark.data());
+    for (int k = 1; k <= families; k++) {
+      Peak peak = correlateFamily(p, k, legendre, nullCorrelator);
+      nullPeaks.push_back(peak.peak2rms);
+      beyond4 += peak.beyond4;
+      beyond5 += peak.beyond5;
+      values += (double)p * p;
+    }
+
+    for (int s = 0; s < strengthCount; s++) {
+      std::vector<double> wmArray(p * p);
+      combineMarks(p, shifts, kStrengths[s], wmArray.data());
+      WatermarkPattern pattern(host.rows, host.cols, p, p, wmArray.data());
+      cv::Mat marked = host.clone();
+      pattern.applyTo(marked);
+      marked = withNoise(random, marked, noise);
+
+      double weakest;
+      bool decoded;
+      detectMessage(extracted(marked, host, p), p, shifts, legendre, weakest, decoded);
+      informed[s].push_back(decoded ? weakest : 0);
+      detectMessage(extracted(marked, cv::Mat(), p), p, shifts, legendre, weakest, decoded);
+      blind[s].push_back(decoded ? weakest : 0);
+    }
+    fprintf(stderr, "image %d of %d\n", image + 1, images);
+  }
+
+  int p = (int)(pSum / images + 0.5);
+  printf("%d %s images, %dx%d (p about %d), texture %.1f, noise %.1f, message \"%s\"\n",
+         images, files.empty() ? "synthetic" : "given", rows, cols, p, texture, noise,
+         message.c_str());
+  printf("weakest family's peak-to-RMS, median (min, 0 for a wrong shift), and messages\n"
+         "decoded above the fixed threshold of 6\n");
+  printf("%8s  %22s  %22s\n", "strength", "informed", "blind");
+  for (int s = 0; s < strengthCount; s++) {
+    printf("%8d  %9.1f (%7.1f) %3d/%-3d  %9.1f (%7.1f) %3d/%-3d\n", kStrengths[s],
+           median(informed[s]), *std::min_element(informed[s].begin(), informed[s].end()),
+           passing(informed[s], kInformedThreshold), images, median(blind[s]),
+           *std::min_element(blind[s].begin(), blind[s].end()),
+           passing(blind[s], kInformedThreshold), images);
+  }
+
+  std::sort(nullPeaks.begin(), nullPeaks.end());
+  printf("unmarked, blind: %d family peaks, median %.2f, max %.2f (normal model: median %.2f, "
+         "1e-3 %.2f)\n",
+         (int)nullPeaks.size(), median(nullPeaks), nullPeaks.back(),
+         thresholdForFalsePositive(p, 0.5), thresholdForFalsePositive(p, 1e-3));
+  printf("  values past 4 RMS %.3g (normal %.3g), past 5 RMS %.3g (normal %.3g)\n",
+         beyond4 / values, twoSidedTail(4), beyond5 / values, twoSidedTail(5));
+  const double rates[] = {1e-2, 1e-3, 1e-4, 1e-6};
+  for (double rate : rates) {
+    double threshold = thresholdForFalsePositive(p, rate);
+    int above = (int)(nullPeaks.end() - std::upper_bound(nullPeaks.begin(), nullPeaks.end(),
+                                                          threshold));
+    printf("  rate %.0e: threshold %.2f, unmarked families above %d, blind marks passing",
+           rate, threshold, above);
+    for (int s = 0; s < strengthCount; s++) printf(" %d", passing(blind[s], threshold));
+    printf("\n");
+  }
+  printf("  fixed 6: false positive rate %.2g per family\n",
+         std::pow(10.0, log10FalsePositive(p, kInformedThreshold)));
+  return 0;
+}
@@ -0,0 +1,93 @@
+// bluesteinDft against cv::dft for the prime sizes of the watermark arrays,
+// p from about 1000 (a 1 MP image) to 6000 (36 MP), and how far apart their
+// results are.
+//   BluesteinBenchmark [--rows n | --full] [--runs n] [--float] [p ...]
+// cv::dft is O(p) per element of a prime length row, so a whole p x p
+// transform takes minutes at the larger sizes. By default a strip of rows (16)
+// is transformed in 2d, where the rows dominate and the short columns cost
+// either transform the same, and the time of the p x p transform, 2p such
+// rows, is estimated from it. --full transforms the whole p x p array.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "watermarking-functions/BluesteinDft.hpp"
+#include "watermarking-functions/Utilities.hpp"
+
+namespace {
+
+const int kPrimes[] = {1009, 1499, 2003, 2503, 3001, 4001, 5003, 6007};
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// the fastest of runs forward transforms of input, with its result
+template <typename Transform>
+double fastest(int runs, const cv::Mat& input, cv::Mat& output, Transform transform) {
+  double best = 1e30;
+  for (int r = 0; r < runs; r++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    transform(input, output);
+    best = std::min(best, millisecondsSince(start));
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int rows = 16, runs = 3, depth = CV_64F;
+  bool full = false;
+  std::vector<int> primes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    int p;
+    if (arg == "--rows" && i + 1 < argc && parseNumber(argv[i + 1], rows) && rows > 0) {
+      i++;
+    } else if (arg == "--runs" && i + 1 < argc && parseNumber(argv[i + 1], runs) && runs > 0) {
+      i++;
+    } else if (arg == "--full") {
+      full = true;
+    } else if (arg == "--float") {
+      depth = CV_32F;
+    } else if (parseNumber(arg, p) && p > 2) {
+      primes.push_back(p);
+    } else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (primes.empty()) primes.assign(std::begin(kPrimes), std::end(kPrimes));
+
+  cv::setRNGSeed(1);
+  printf("%s, %s, best of %d\n", depth == CV_64F ? "double" : "float",
+         full ? "whole p x p transforms" : "strips of rows, p x p estimated", runs);
+  printf("%6s  %6s  %12s  %12s  %8s  %14s  %14s\n", "p", "m", "cv::dft ms", "bluestein ms",
+         "speedup", "p x p dft ms", "p x p blue ms");
+  for (int p : primes) {
+    int strip = full ? p : std::min(rows, p);
+    cv::Mat input(strip, p, CV_MAKETYPE(depth, 2)), expected, actual;
+    cv::randu(input, -1.0, 1.0);
+
+    double dftTime = fastest(runs, input, expected,
+                             [](const cv::Mat& src, cv::Mat& dst) { cv::dft(src, dst); });
+    double bluesteinTime = fastest(runs, input, actual, [](const cv::Mat& src, cv::Mat& dst) {
+      bluesteinDft(src, dst);
+    });
+
+    // a strip's rows are half the rows and columns of a p x p transform
+    double scale = full ? 1.0 : 2.0 * p / strip;
+    double error = cv::norm(actual, expected, cv::NORM_INF) / cv::norm(expected, cv::NORM_INF);
+    printf("%6d  %6d  %12.1f  %12.1f  %7.1fx  %14.0f  %14.0f  (error %.1g)\n", p,
+           cv::getOptimalDFTSize(2 * p - 1), dftTime, bluesteinTime, dftTime / bluesteinTime,
+           dftTime * scale, bluesteinTime * scale, error);
+  }
+  return 0;
+}
@@ -0,0 +1,185 @@
+// Double against single precision (--float) through marking and detection:
+// the time to build a pattern, extract the mark and correlate the message
+// families, and how far float moves the pattern, the marked pixels and each
+// family's peak-to-RMS.
+//   PrecisionBenchmark [--fft opencv|native] [--runs n] [--message text]
+//                      [--strength n] [rowsxcols ...]
+// Sizes default to 480x640 (VGA) up to 3000x4000 (12 MP). The host plane is
+// uniform noise, detection subtracts it so its content doesn't matter.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/LegendreSpectrum.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+#include "watermarking-functions/MarkCorrelator.hpp"
+#include "watermarking-functions/Utilities.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+#include "watermarking-functions/WatermarkPattern.hpp"
+
+namespace {
+
+struct Timings {
+  double pattern;
+  double extraction;
+  double correlation;
+};
+
+// what one precision produced for one size
+struct Run {
+  Timings best;
+  WatermarkPattern pattern;
+  cv::Mat marked;
+  std::vector<double> peak2rms;  // per family
+  bool decoded;
+};
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// correlate each family with the extracted mark as detect-wm does, the shift
+// is decoded from the peak position
+template <typename T>
+void correlateFamilies(int p, const std::vector<T>& extracted, const std::vector<int>& shifts,
+                       std::vector<double>& peak2rms, bool& decoded) {
+  MarkCorrelator<T> correlator(p, p, extracted.data());
+  LegendreSpectrum legendre(p);
+  cv::Mat spectrum;
+  std::vector<T> correlation(p * p);
+
+  peak2rms.clear();
+  decoded = true;
+  for (size_t i = 0; i < shifts.size(); i++) {
+    legendre.spectrumFor((int)i + 1, spectrum, cv::DataType<T>::depth);
+    correlator.correlateSpectrum(spectrum, correlation.data());
+
+    int peak = 0;
+    double ms = 0;
+    for (int j = 0; j < p * p; j++) {
+      if (correlation[j] > correlation[peak]) peak = j;
+      ms += (double)correlation[j] * correlation[j] / (p * p);
+    }
+    peak2rms.push_back(correlation[peak] / std::sqrt(ms));
+    decoded = decoded && peak == shifts[i];
+  }
+}
+
+// mark the host plane and detect the message in precision T, runs times,
+// keeping the fastest time of each stage
+template <typename T>
+Run runPrecision(const cv::Mat& host, int p, const std::vector<int>& shifts, int strength,
+                 int runs) {
+  Run run;
+  run.best.pattern = run.best.extraction = run.best.correlation = 1e30;
+  cv::Mat luma(host.size(), cv::DataType<T>::type);
+  for (int r = 0; r < runs; r++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<double> wmArray(p * p);
+    combineMarks(p, shifts, strength, wmArray.data());
+    run.pattern = WatermarkPattern(host.rows, host.cols, p, p, wmArray.data(),
+                                   cv::DataType<T>::depth);
+    run.best.pattern = std::min(run.best.pattern, millisecondsSince(start));
+
+    run.marked = host.clone();
+    run.pattern.applyTo(run.marked);
+
+    start = std::chrono::high_resolution_clock::now();
+    planeDifferenceToLuma(run.marked, host, luma.ptr<T>(0));
+    std::vector<T> extracted(p * p);
+    extractMark(LumaView<T>(luma), LumaView<T>(extracted.data(), p, p));
+    run.best.extraction = std::min(run.best.extraction, millisecondsSince(start));
+
+    start = std::chrono::high_resolution_clock::now();
+    correlateFamilies(p, extracted, shifts, run.peak2rms, run.decoded);
+    run.best.correlation = std::min(run.best.correlation, millisecondsSince(start));
+  }
+  return run;
+}
+
+void printTimings(const char* precision, const Run& run) {
+  printf("  %-6s  pattern %9.1f ms  extract %9.1f ms  correlate %9.1f ms  %s\n", precision,
+         run.best.pattern, run.best.extraction, run.best.correlation,
+         run.decoded ? "decoded" : "NOT DECODED");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string backend = "opencv", message = "Hi there";
+  int runs = 3, strength = 10;
+  std::vector<cv::Size> sizes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    int rows, cols;
+    if (arg == "--fft" && i + 1 < argc) {
+      backend = argv[++i];
+    } else if (arg == "--runs" && i + 1 < argc && parseNumber(argv[i + 1], runs) && runs > 0) {
+      i++;
+    } else if (arg == "--message" && i + 1 < argc) {
+      message = argv[++i];
+    } else if (arg == "--strength" && i + 1 < argc && parseNumber(argv[i + 1], strength)) {
+      i++;
+    } else if (sscanf(argv[i], "%dx%d", &rows, &cols) == 2 && rows > 0 && cols > 0) {
+      sizes.push_back(cv::Size(cols, rows));
+    } else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (sizes.empty()) {
+    sizes = {cv::Size(640, 480), cv::Size(1280, 960), cv::Size(2048, 1536),
+             cv::Size(4000, 3000)};
+  }
+  if (!setFftBackend(backend)) {
+    fprintf(stderr, "unknown backend: %s\n", backend.c_str());
+    return 2;
+  }
+
+  cv::setRNGSeed(1);
+  printf("backend %s, message \"%s\", strength %d, best of %d\n", backend.c_str(),
+         message.c_str(), strength, runs);
+  for (const cv::Size& size : sizes) {
+    cv::Mat host(size, CV_8U);
+    cv::randu(host, 0, 256);
+    int p = largestPrimeFor(size.height, size.width);
+    std::vector<int> shifts = getShifts(message, p * p);
+
+    Run doubles = runPrecision<double>(host, p, shifts, strength, runs);
+    Run floats = runPrecision<float>(host, p, shifts, strength, runs);
+
+    // float against double: the pattern in 8-bit units, the pixels it rounds
+    // to, and each family's peak-to-RMS
+    double patternError = cv::norm(floats.pattern.mat(), doubles.pattern.mat(), cv::NORM_INF);
+    cv::Mat differing;
+    cv::compare(floats.marked, doubles.marked, differing, cv::CMP_NE);
+    double worstPeak = 0, lowestPeak = 1e30;
+    for (size_t i = 0; i < doubles.peak2rms.size(); i++) {
+      worstPeak = std::max(worstPeak, std::fabs(floats.peak2rms[i] - doubles.peak2rms[i]) /
+                                          doubles.peak2rms[i]);
+      lowestPeak = std::min(lowestPeak, doubles.peak2rms[i]);
+    }
+
+    printf("%dx%d, p = %d, %d families, lowest peak-to-RMS %.2f\n", size.height, size.width, p,
+           (int)shifts.size(), lowestPeak);
+    printTimings("double", doubles);
+    printTimings("float", floats);
+    printf("  float/double time  pattern %.2f  extract %.2f  correlate %.2f\n",
+           floats.best.pattern / doubles.best.pattern,
+           floats.best.extraction / doubles.best.extraction,
+           floats.best.correlation / doubles.best.correlation);
+    printf("  float error  pattern %.2g levels  marked pixels changed %d of %d  "
+           "peak-to-RMS %.2g relative\n",
+           patternError, cv::countNonZero(differing), (int)host.total(), worstPeak);
+  }
+  return 0;
+}
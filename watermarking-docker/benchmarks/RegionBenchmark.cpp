@@ -0,0 +1,120 @@
+// A forward and inverse transform pair over the whole image against the same
+// pair over the smooth region (--region smooth), at 20 resolutions between
+// 600x450 and 640x480, for each backend: the time at each size, then the
+// mean, standard deviation and range over the sizes.
+//   RegionBenchmark [--runs n] [--float] [--fft opencv|native] [rowsxcols ...]
+// Without --fft both backends are timed.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/Utilities.hpp"
+
+namespace {
+
+struct Shape {
+  int rows;
+  int cols;
+};
+
+// close to 4:3, the rows nudged so the sizes' factors vary
+std::vector<Shape> sweepShapes() {
+  std::vector<Shape> shapes;
+  for (int cols = 600; cols < 640; cols += 2) {
+    Shape shape = {cols * 3 / 4 + cols % 7, cols};
+    shapes.push_back(shape);
+  }
+  return shapes;
+}
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// the fastest of runs forward and inverse pairs over region of input, after
+// an untimed pair so the plans and their scratch are in place
+double fastestPair(int runs, const cv::Mat& input, const cv::Rect& region) {
+  cv::Mat warm = input(region).clone();
+  realDft(warm);
+  realDft(warm, true);
+
+  double best = 1e30;
+  for (int r = 0; r < runs; r++) {
+    cv::Mat mat = input(region).clone();
+    auto start = std::chrono::high_resolution_clock::now();
+    realDft(mat);
+    realDft(mat, true);
+    best = std::min(best, millisecondsSince(start));
+  }
+  return best;
+}
+
+void printSummary(const char* mode, const std::vector<double>& times) {
+  double mean = 0, variance = 0;
+  for (double t : times) mean += t / times.size();
+  for (double t : times) variance += (t - mean) * (t - mean) / times.size();
+  printf("  %-6s  mean %6.1f ms  sd %5.1f ms  range %.1f-%.1f ms\n", mode, mean,
+         std::sqrt(variance), *std::min_element(times.begin(), times.end()),
+         *std::max_element(times.begin(), times.end()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int runs = 3, depth = CV_64F;
+  std::vector<std::string> backends = {"opencv", "native"};
+  std::vector<Shape> shapes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    int rows, cols;
+    if (arg == "--runs" && i + 1 < argc && parseNumber(argv[i + 1], runs) && runs > 0) {
+      i++;
+    } else if (arg == "--float") {
+      depth = CV_32F;
+    } else if (arg == "--fft" && i + 1 < argc &&
+               (std::string(argv[i + 1]) == "opencv" || std::string(argv[i + 1]) == "native")) {
+      backends.assign(1, argv[++i]);
+    } else if (sscanf(argv[i], "%dx%d", &rows, &cols) == 2 && rows > 3 && cols > 3) {
+      Shape shape = {rows, cols};
+      shapes.push_back(shape);
+    } else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (shapes.empty()) shapes = sweepShapes();
+
+  cv::setRNGSeed(1);
+  for (const std::string& backend : backends) {
+    setFftBackend(backend);
+    printf("%s forward and inverse, %s, best of %d\n", backend.c_str(),
+           depth == CV_64F ? "double" : "float", runs);
+    printf("%11s  %11s  %10s  %10s  %7s\n", "size", "smooth", "full ms", "smooth ms", "speedup");
+
+    std::vector<double> fullTimes, smoothTimes;
+    for (const Shape& shape : shapes) {
+      cv::Mat input(shape.rows, shape.cols, depth);
+      cv::randu(input, 0.0, 1.0);
+      cv::Rect full, smooth;
+      regionFor("full", shape.rows, shape.cols, full);
+      regionFor("smooth", shape.rows, shape.cols, smooth);
+
+      fullTimes.push_back(fastestPair(runs, input, full));
+      smoothTimes.push_back(fastestPair(runs, input, smooth));
+      printf("%5dx%-5d  %5dx%-5d  %10.1f  %10.1f  %6.2fx\n", shape.rows, shape.cols,
+             smooth.height, smooth.width, fullTimes.back(), smoothTimes.back(),
+             fullTimes.back() / smoothTimes.back());
+    }
+    printSummary("full", fullTimes);
+    printSummary("smooth", smoothTimes);
+  }
+  return 0;
+}
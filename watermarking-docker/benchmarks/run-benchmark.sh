@@ -0,0 +1,35 @@
+#!/bin/bash
+# Build one benchmarks/<name>.cpp against the watermarking library, the way
+# tests/run-tests.sh builds the tests, and run it with the remaining arguments
+# (eg. benchmarks/run-benchmark.sh PrecisionBenchmark --fft native).
+#   OPENCV_CFLAGS, OPENCV_LIBS  OpenCV's include and link flags (default: the
+#                               system's, as in the Dockerfile)
+#   BUILD_DIR                   where the library objects and benchmarks are built
+set -e
+cd "$(dirname "$0")/.."
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 <benchmark> [args...]" >&2
+  exit 2
+fi
+name=$1
+shift
+
+OPENCV_CFLAGS=${OPENCV_CFLAGS:-"-I/usr/include -I/usr/include/opencv4"}
+OPENCV_LIBS=${OPENCV_LIBS:-"-L/usr/lib/x86_64-linux-gnu -lopencv_core -lopencv_imgcodecs \
+  -lopencv_imgproc"}
+BUILD_DIR=${BUILD_DIR:-/tmp/watermarking-benchmarks}
+CXXFLAGS="-std=c++11 -O2 -I. -pthread"
+
+mkdir -p "$BUILD_DIR"
+objects=()
+for source in watermarking-functions/*.cpp; do
+  [ "$source" = watermarking-functions/ObjectDetection.cpp ] && continue
+  object="$BUILD_DIR/$(basename "$source" .cpp).o"
+  g++ $CXXFLAGS $OPENCV_CFLAGS -c "$source" -o "$object"
+  objects+=("$object")
+done
+
+g++ $CXXFLAGS $OPENCV_CFLAGS "benchmarks/$name.cpp" "${objects[@]}" $OPENCV_LIBS \
+  -o "$BUILD_DIR/$name"
+exec "$BUILD_DIR/$name" "$@"
@@ -7,15 +7,60 @@
 //
 
 #include <opencv2/opencv.hpp>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <map>
+#include <mutex>
 #include <numeric>
 
+#include "watermarking-functions/FalsePositive.hpp"
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/ImageRegistration.hpp"
+#include "watermarking-functions/LegendreSpectrum.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+#include "watermarking-functions/MarkCorrelator.hpp"
+#include "watermarking-functions/OriginalSidecar.hpp"
+#include "watermarking-functions/Parallel.hpp"
 #include "watermarking-functions/Utilities.hpp"
 #include "watermarking-functions/WatermarkDetection.hpp"
+#include "watermarking-functions/json.hpp"
+
+// print progress lines (off when several captures are detected at once, their
+// json result lines are printed instead)
+static bool logProgress = true;
+
+// neighbourhood the extracted mark is whitened over in blind detection
+static const int kWhiteningRadius = 4;
+
+// false positive rate per family blind detection sets its threshold from
+// when --fp-rate isn't given. The whitened correlations of unmarked images
+// follow FalsePositive's normal model (see BlindDetectionBenchmark), so the
+// threshold is the model's for this p rather than the fixed 6 (about 2e-4 at
+// p = 467). It is stricter as blind detection runs on any image, with no
+// original to vouch for a match.
+static const double kBlindFalsePositiveRate = 1e-6;
+
+// p x p arrays of T a family worker holds: the family's spectrum and its
+// product with the mark's (complex, two each), the correlation, and the two
+// complex transposes of a Bluestein transform
+static const int kFamilyWorkerArrays = 9;
+
+// the workers to use, workerCount when --workers gave it (> 0), otherwise one
+// per core but no more than fit in memory when each needs workerBytes
+static int workersFor(int workerCount, size_t workerBytes) {
+  if (workerCount > 0) return workerCount;
+  return workersWithinMemory(defaultWorkerCount(), workerBytes);
+}
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
 
 // Helper to calculate statistics for correlation matrix
-void calculateCorrelationStats(double* correlationVals, int size,
+template <typename T>
+void calculateCorrelationStats(T* correlationVals, int size,
                                double& minVal, double& maxVal,
                                double& mean, double& stdDev) {
   minVal = correlationVals[0];
@@ -38,167 +83,324 @@ void calculateCorrelationStats(double* correlationVals, int size,
   stdDev = sqrt(sumSquaredDiff / size);
 }
 
-int main(int argc, const char* argv[]) {
-  // Start total timer
-  auto totalStart = std::chrono::high_resolution_clock::now();
+// correlate family k with the extracted mark and find its peak
+template <typename T>
+static SequenceStats evaluateFamily(int p, int k, const LegendreSpectrum& legendre,
+                                    MarkCorrelator<T>& correlator, cv::Mat& wmSpectrum,
+                                    T* correlationVals) {
+  int maxX, maxY;
+  double ms, peak2rms, maxVal;
 
-  // check args have been passed in
-  // args are: unique id for db entry, file path for original image, file path
-  // for marked image
-  if (argc != 4) {
-    std::cout << "incorrect number of arguments" << std::endl;
-    return -1;
+  // generate the spectrum of the array and perform correlation
+  legendre.spectrumFor(k, wmSpectrum, cv::DataType<T>::depth);
+  correlator.correlateSpectrum(wmSpectrum, correlationVals);
+
+  // calculate peak value and peak2rms for this family of arrays
+  maxVal = 0.0;
+  maxX = -1;
+  maxY = -1;
+  for (int y = 0; y < p; y++) {
+    for (int x = 0; x < p; x++) {
+      if (correlationVals[y * p + x] > maxVal) {
+        maxVal = correlationVals[y * p + x];
+        maxY = y;
+        maxX = x;
+      }
+    }
   }
 
-  std::string uid = argv[argc - 3];  // the userid, used in the file path for saving results
-  std::string originalFilePath = argv[argc - 2];
-  std::string markedFilePath = argv[argc - 1];
-  std::string outputFilePath = "/tmp/" + uid + ".json";
-
-  std::cout << "user with id " << uid << ", detecting message in marked image at " << markedFilePath
-            << std::endl;
-
-  // Initialize detection stats
-  DetectionStats stats;
-  stats.threshold = 6.0;  // Detection threshold
+  // calculate peak2rms
+  ms = 0;
+  for (int i = 0; i < p * p; i++)
+    ms += (correlationVals[i] * correlationVals[i]) / (p * p);
+  double rmsVal = sqrt(ms);
+  peak2rms = maxVal / rmsVal;
+
+  // Store sequence statistics
+  SequenceStats seqStats;
+  seqStats.k = k;
+  seqStats.psnr = peak2rms;
+  seqStats.peakX = maxX;
+  seqStats.peakY = maxY;
+  seqStats.peakVal = maxVal;
+  seqStats.rms = rmsVal;
+  seqStats.shift = maxY * p + maxX;
+  seqStats.log10PValue = log10FalsePositive(p, peak2rms);
+  return seqStats;
+}
 
-  int p, k, maxX, maxY, imgRows, imgCols;
-  double ms, peak2rms, maxVal;
-  std::vector<int> shifts;
+// the families first..last
+static std::vector<int> familyRange(int first, int last) {
+  std::vector<int> families;
+  for (int k = first; k <= last; k++) families.push_back(k);
+  return families;
+}
 
-  // Time image loading
-  auto loadStart = std::chrono::high_resolution_clock::now();
+// correlate each of families with the extracted mark and return their results
+// in the order given
+// - the families are independent once the mark is extracted, so workers take
+//   the next family in turn (no more workers than families are started)
+// - with stopAtFailure, workers run ahead of the first family below threshold
+//   by at most the number of workers, and only families up to it are
+//   returned, exactly as the sequential loop did
+// - the correlation matrix statistics are those of the last family returned
+template <typename T>
+static std::vector<SequenceStats> correlateFamilies(int p, const std::vector<int>& families,
+                                                    bool stopAtFailure, int workerCount,
+                                                    const LegendreSpectrum& legendre,
+                                                    const MarkCorrelator<T>& correlator,
+                                                    DetectionStats& stats) {
+  if (families.empty()) return std::vector<SequenceStats>();
+
+  int last = (int)families.size() - 1;
+  std::vector<SequenceStats> results(families.size());
+  std::atomic<int> nextIndex(0);
+  std::atomic<int> stopIndex(last);
+  std::mutex resultsMutex;
+
+  runWorkers(std::min(workerCount, (int)families.size()), [&](int) {
+    // copies share the mark spectrum, each has its own buffers
+    MarkCorrelator<T> workerCorrelator(correlator);
+    cv::Mat wmSpectrum;
+    T* correlationVals = new T[p * p];
+
+    for (int i = nextIndex++; i <= stopIndex; i = nextIndex++) {
+      int k = families[i];
+      if (logProgress) {
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        std::cout << "PROGRESS:Analyzing sequence " << k << "..." << std::endl;
+      }
 
-  // read in images and convert to 3 channel BGR
-  cv::Mat original = cv::imread(originalFilePath, cv::IMREAD_COLOR);
-  cv::Mat marked = cv::imread(markedFilePath, cv::IMREAD_COLOR);
+      SequenceStats seqStats =
+          evaluateFamily(p, k, legendre, workerCorrelator, wmSpectrum, correlationVals);
+
+      std::lock_guard<std::mutex> lock(resultsMutex);
+      results[i] = seqStats;
+      bool stops = stopAtFailure && seqStats.psnr <= stats.threshold && i < stopIndex;
+      if (stops) stopIndex = i;
+      if (stops || i == last) {
+        // Calculate correlation matrix statistics (from last tested sequence)
+        calculateCorrelationStats(correlationVals, p * p, stats.correlationMin,
+                                  stats.correlationMax, stats.correlationMean,
+                                  stats.correlationStdDev);
+      }
+    }
 
-  auto loadEnd = std::chrono::high_resolution_clock::now();
-  stats.timeImageLoad = std::chrono::duration<double, std::milli>(loadEnd - loadStart).count();
+    delete[] correlationVals;
+  });
 
-  std::cout << "images read in and converted to 3 channel BGR " << std::endl;
+  results.resize(stopIndex + 1);
+  return results;
+}
 
-  // check original and marked images are of equal size
-  if (original.rows != marked.rows || original.cols != marked.cols) {
-    std::cout << "Original and marked images are not equal sizes. Resizing marked image to match "
-                 "original."
-              << std::endl;
-    std::cout << "Original: " << original.cols << "x" << original.rows
-              << ", Marked: " << marked.cols << "x" << marked.rows << std::endl;
-    cv::resize(marked, marked, original.size());
+// the original a capture is compared with, decoded from an image or mapped
+// from a sidecar (.wmo)
+struct Original {
+  cv::Mat valuePlane;
+  std::string regionMode;
+  cv::Rect region;  // the part of the plane the mark was added to
+  int p;
+  const double* block;  // the original's extracted block, when a sidecar has one
+  OriginalSidecar sidecar;
+};
+
+// load the original, with the region regionMode gives for its size (a
+// sidecar's own region wins, it is the one the original was marked in)
+static bool loadOriginal(const std::string& filePath, const std::string& regionMode,
+                         Original& original) {
+  original.block = nullptr;
+  original.regionMode = regionMode;
+  if (isOriginalSidecar(filePath)) {
+    if (!original.sidecar.open(filePath)) return false;
+    original.valuePlane = original.sidecar.valuePlane();
+    original.region = original.sidecar.region();
+    original.p = original.sidecar.p();
+    original.block = original.sidecar.block();
+
+    cv::Rect asked;
+    regionFor(regionMode, original.valuePlane.rows, original.valuePlane.cols, asked);
+    if (original.region != asked) original.regionMode = regionMode == "full" ? "smooth" : "full";
+    return true;
   }
 
-  // set variables for the image rows and cols, now we know original and marked
-  // are the same size
-  imgRows = original.rows;
-  imgCols = original.cols;
-
-  // Store image properties
-  stats.imageWidth = imgCols;
-  stats.imageHeight = imgRows;
-
-  // calculate the largest prime for this image
-  p = largestPrimeFor(original);
-  stats.primeSize = p;
-
-  std::cout << "largest prime was found to be " << p << std::endl;
-
-  // convert images to HSV
-  cv::Mat hsvOriginal, hsvMarked;
-  cvtColor(original, hsvOriginal, cv::COLOR_BGR2HSV);
-  cvtColor(marked, hsvMarked, cv::COLOR_BGR2HSV);
+  // read in image and convert to 3 channel BGR
+  cv::Mat image = cv::imread(filePath, cv::IMREAD_COLOR);
+  if (image.empty()) return false;
+  regionFor(regionMode, image.rows, image.cols, original.region);
+  original.p = largestPrimeFor(original.region.height, original.region.width);
+  extractValue(image, original.valuePlane);
+  return true;
+}
 
-  // create 1d array for luma values
-  double* lumaArray = new double[imgCols * imgRows];
-  // subtract original luma from marked luma and store the result
-  for (int y = 0; y < imgRows; y++) {
-    for (int x = 0; x < imgCols; x++) {
-      lumaArray[y * imgCols + x] =
-          (hsvMarked.at<cv::Vec3b>(y, x).val[2] - hsvOriginal.at<cv::Vec3b>(y, x).val[2]) / 255.0;
-    }
-  }
+// extract the mark from the difference between the marked and original luma
+// planes over the region the mark was added to, computing the transform with
+// precision T
+// - in double precision, an original with its extracted block is subtracted
+//   after extracting the marked plane alone (the extraction is linear),
+//   leaving the original plane unread
+// - without an original (blind detection) the marked plane's block is
+//   whitened instead, to suppress the host image
+// - the luma is written to, and transformed in, the caller's luma buffer,
+//   which keeps its memory between captures of the same size
+template <typename T>
+static std::vector<T> extractDifference(const cv::Mat& valueMarked, const Original* original,
+                                        const cv::Rect& region, int p, cv::Mat& luma,
+                                        DetectionStats& stats) {
+  bool useBlock = original != nullptr && original->block != nullptr &&
+                  cv::DataType<T>::depth == CV_64F;
+
+  // the region's luma values
+  luma.create(region.size(), cv::DataType<T>::type);
+  T* lumaArray = luma.ptr<T>(0);
+  if (original == nullptr || useBlock)
+    planeToLuma(valueMarked(region), lumaArray);
+  else
+    planeDifferenceToLuma(valueMarked(region), original->valuePlane(region), lumaArray);
 
   // Time extraction phase
   auto extractStart = std::chrono::high_resolution_clock::now();
 
   // extract the watermark from the frequency domain
-  std::cout << "PROGRESS:Extracting watermark from frequency domain..." << std::endl;
-  double* extractedMark = new double[p * p];
-  extractMark(hsvOriginal.rows, hsvOriginal.cols, p, p, lumaArray, extractedMark);
-
-  auto extractEnd = std::chrono::high_resolution_clock::now();
-  stats.timeExtraction = std::chrono::duration<double, std::milli>(extractEnd - extractStart).count();
+  if (logProgress) {
+    std::cout << "PROGRESS:Extracting watermark from frequency domain..." << std::endl;
+  }
+  std::vector<T> extractedMark(p * p);
+  extractMark(LumaView<T>(luma), LumaView<T>(extractedMark.data(), p, p));
+  if (useBlock) {
+    for (int i = 0; i < p * p; i++) extractedMark[i] -= (T)original->block[i];
+  }
+  if (original == nullptr) whitenMark(p, extractedMark.data(), kWhiteningRadius);
 
-  double* wmArray = new double[p * p];
-  double* correlationVals = new double[p * p];
+  stats.timeExtraction = millisecondsSince(extractStart);
+  return extractedMark;
+}
 
+// find the shift of each family of arrays in an extracted mark, computing the
+// transforms with precision T
+template <typename T>
+static void detectShifts(std::vector<T> extractedMark, int p, int workerCount,
+                         const std::string& framing, DetectionStats& stats,
+                         std::vector<int>& shifts) {
   // Time correlation phase
   auto corrStart = std::chrono::high_resolution_clock::now();
 
+  // the extracted mark is the same for every family, transform it once, and
+  // write the spectrum of each family's array directly
+  MarkCorrelator<T> correlator(p, p, extractedMark.data());
+  std::vector<T>().swap(extractedMark);
+  LegendreSpectrum legendre(p);
+
+  if (workerCount > 1) cv::setNumThreads(1);
+
   // perform detection for each family of arrays (family determined by k value)
-  k = 1;
-  while (1) {
-    if (k >= 1) {
-      std::cout << "PROGRESS:Analyzing sequence " << k << "..." << std::endl;
-    }
-    // generate each array and perform correlation
-    generateArray(p, k, wmArray);
-    fastCorrelation(p, p, extractedMark, wmArray, correlationVals);
-
-    // calculate peak value and peak2rms for this family of arrays
-    maxVal = 0.0;
-    maxX = -1;
-    maxY = -1;
-    for (int y = 0; y < p; y++) {
-      for (int x = 0; x < p; x++) {
-        if (correlationVals[y * p + x] > maxVal) {
-          maxVal = correlationVals[y * p + x];
-          maxY = y;
-          maxX = x;
-        }
+  // - framed messages: read the header family first, then all the families it
+  //   counts at once, and check the checksum
+  // - legacy messages: read families until one falls below threshold
+  // - auto: the header family and the first family are read together, in one
+  //   pass, then the header decides which of the two goes on
+  std::vector<SequenceStats> sequences;
+  bool framed = false;
+  if (framing != "legacy") {
+    std::vector<int> families(1, frameHeaderFamily(p));
+    if (framing == "auto") families.push_back(1);
+    std::vector<SequenceStats> read =
+        correlateFamilies(p, families, false, workerCount, legendre, correlator, stats);
+    SequenceStats header = read[0];
+    int count = frameDigitCount(p, header.shift);
+
+    if (header.psnr > stats.threshold && count < frameHeaderFamily(p)) {
+      framed = true;
+      if (count > 0) {
+        // the first family has been read already in auto
+        sequences.assign(read.begin() + 1, read.end());
+        std::vector<SequenceStats> rest =
+            correlateFamilies(p, familyRange((int)sequences.size() + 1, count), false,
+                              workerCount, legendre, correlator, stats);
+        sequences.insert(sequences.end(), rest.begin(), rest.end());
       }
-    }
+      for (size_t i = 0; i < sequences.size(); i++) shifts.push_back(sequences[i].shift);
+
+      stats.frameValid = frameHeader(p, shifts) == header.shift;
+      if (!stats.frameValid) shifts.clear();
 
-    // calculate peak2rms
-    ms = 0;
-    for (int i = 0; i < p * p; i++)
-      ms += (correlationVals[i] * correlationVals[i]) / (p * p);
-    double rmsVal = sqrt(ms);
-    peak2rms = maxVal / rmsVal;
-
-    // Store sequence statistics
-    SequenceStats seqStats;
-    seqStats.k = k;
-    seqStats.psnr = peak2rms;
-    seqStats.peakX = maxX;
-    seqStats.peakY = maxY;
-    seqStats.peakVal = maxVal;
-    seqStats.rms = rmsVal;
-    seqStats.shift = maxY * p + maxX;
-    stats.sequences.push_back(seqStats);
-
-    // increment k to move on to next family
-    k++;
-
-    if (peak2rms > stats.threshold) {
-      shifts.push_back(maxY * p + maxX);  // store the detected shift
+      // reported after the message families
+      sequences.push_back(header);
+    } else if (framing == "framed") {
+      sequences.push_back(header);
     } else {
-      break;
+      sequences.assign(read.begin() + 1, read.end());
     }
   }
 
-  auto corrEnd = std::chrono::high_resolution_clock::now();
-  stats.timeCorrelation = std::chrono::duration<double, std::milli>(corrEnd - corrStart).count();
+  if (!framed && framing != "framed") {
+    // the first family decides whether there is a message at all, so an
+    // unmarked image (the common case) stops after it rather than with a
+    // family read ahead by every worker. legacy reads it on its own, auto has
+    // read it in the same pass as the header family, so there an unmarked
+    // image costs both
+    if (sequences.empty()) {
+      sequences = correlateFamilies(p, familyRange(1, 1), false, 1, legendre, correlator, stats);
+    }
+    if (sequences[0].psnr > stats.threshold) {
+      std::vector<SequenceStats> rest =
+          correlateFamilies(p, familyRange(2, frameHeaderFamily(p)), true, workerCount, legendre,
+                            correlator, stats);
+      sequences.insert(sequences.end(), rest.begin(), rest.end());
+    }
+    for (size_t i = 0; i < sequences.size() && sequences[i].psnr > stats.threshold; i++) {
+      shifts.push_back(sequences[i].shift);  // store the detected shift
+    }
+  }
+
+  stats.framing = framed ? "framed" : (framing == "framed" ? "none" : "legacy");
+  stats.sequences = sequences;
 
-  // Calculate correlation matrix statistics (from last tested sequence)
-  calculateCorrelationStats(correlationVals, p * p,
-                            stats.correlationMin, stats.correlationMax,
-                            stats.correlationMean, stats.correlationStdDev);
+  stats.timeCorrelation = millisecondsSince(corrStart);
 
   // Store total sequences tested
-  stats.totalSequencesTested = k - 1;
+  stats.totalSequencesTested = sequences.size();
   stats.sequencesAboveThreshold = shifts.size();
+}
 
+static void initStats(DetectionStats& stats, bool singlePrecision) {
+  stats.threshold = 6.0;  // Detection threshold
+  stats.precision = singlePrecision ? "float" : "double";
+  stats.frameValid = false;
+  stats.blind = false;
+  stats.registered = false;
+  stats.timeRegistration = 0.0;
+  stats.fpRate = 0.0;
+  stats.log10FalsePositive = 0.0;
+}
+
+// with a target false positive rate, replace the fixed threshold by the
+// peak-to-RMS an unmarked image reaches with that probability. With auto
+// framing an unmarked image has two chances, the first family and the header
+// family, but a header above threshold only yields a message when the random
+// shifts of the families it counts also match its checksum (1 in p). So the
+// two together come to (1 + 1/p) times the rate each is held to.
+static void setFalsePositiveRate(DetectionStats& stats, int p, double fpRate,
+                                 const std::string& framing) {
+  if (fpRate <= 0) return;
+  stats.fpRate = fpRate;
+  stats.threshold = thresholdForFalsePositive(p, framing == "auto" ? fpRate * p / (p + 1) : fpRate);
+}
+
+// align the marked value plane to the original's when registration is on, or
+// (auto) when the marked image had to be resized to the original's size
+static void alignCapture(const std::string& registration, bool resized,
+                         const cv::Mat& valueOriginal, cv::Mat& valueMarked,
+                         DetectionStats& stats) {
+  if (registration == "off" || (registration == "auto" && !resized)) return;
+
+  auto registerStart = std::chrono::high_resolution_clock::now();
+  registerPlane(valueOriginal, valueMarked, stats.registration);
+  stats.registered = true;
+  stats.timeRegistration = millisecondsSince(registerStart);
+}
+
+// fill in the PSNR summary and the message once the shifts are known
+static void summariseStats(DetectionStats& stats, const std::vector<int>& shifts, int p) {
   // Calculate PSNR statistics
   if (!stats.sequences.empty()) {
     double psnrSum = 0.0;
@@ -223,6 +425,7 @@ int main(int argc, const char* argv[]) {
   // calculate the message from the shifts
   if (shifts.size() != 0) {
     stats.message = getASCII(shifts, p * p);
+    if (logProgress) std::cout << "Message is: " << stats.message << std::endl;
     stats.detected = true;
 
     // Find minimum PSNR among successful sequences (weakest link)
@@ -235,15 +438,401 @@ int main(int argc, const char* argv[]) {
     stats.confidence = minPsnr;
   }
 
+  // the families are independent under no mark, so their probabilities
+  // multiply (a framed message's header is the last sequence)
+  stats.log10FalsePositive = 0.0;
+  if (stats.detected) {
+    for (size_t i = 0; i < shifts.size() && i < stats.sequences.size(); i++)
+      stats.log10FalsePositive += stats.sequences[i].log10PValue;
+    if (stats.framing == "framed") stats.log10FalsePositive += stats.sequences.back().log10PValue;
+  } else {
+    for (const auto& seq : stats.sequences)
+      stats.log10FalsePositive = std::min(stats.log10FalsePositive, seq.log10PValue);
+  }
+}
+
+// detect the message in every {"id", "capture"} record of a json lines
+// manifest against one original, writing /tmp/<id>.json for each and a json
+// result line to stdout. The original is decoded and its value plane extracted
+// once (or mapped from a sidecar), then shared read-only by the workers.
+// With fuseId, the marks extracted from the captures are also averaged (the
+// extraction is linear, so this averages their spectra) and the average is
+// detected as one more result, /tmp/<fuseId>.json, where the mark adds up
+// across captures and their independent noise doesn't.
+template <typename T>
+static int detectCaptures(const std::string& originalFilePath, const std::string& manifestPath,
+                          const std::string& fuseId, int workerCount, const std::string& framing,
+                          const std::string& registration, double fpRate,
+                          const std::string& regionMode) {
+  std::vector<std::string> records;
+  if (!readManifest(manifestPath, records)) return -1;
+
+  bool singlePrecision = cv::DataType<T>::depth == CV_32F;
+
+  auto loadStart = std::chrono::high_resolution_clock::now();
+  Original original;
+  if (!loadOriginal(originalFilePath, regionMode, original)) {
+    std::cout << "unable to read original " << originalFilePath << std::endl;
+    return -1;
+  }
+
+  int p = original.p;
+  int rows = original.valuePlane.rows, cols = original.valuePlane.cols;
+  double loadTime = millisecondsSince(loadStart);
+
+  // a worker holds a capture's planes, then (once they are released) a
+  // family's correlation buffers
+  size_t familyBytes = kFamilyWorkerArrays * (size_t)p * p * sizeof(T);
+  size_t captureBytes = (size_t)rows * cols * (4 + sizeof(T));
+  workerCount = workersFor(workerCount, std::max(familyBytes, captureBytes));
+
+  // captures are detected side by side, spare workers correlate families
+  // within a capture
+  int captureWorkers = std::max(1, std::min(workerCount, (int)records.size()));
+  int familyWorkers = std::max(1, workerCount / captureWorkers);
+  if (workerCount > 1) cv::setNumThreads(1);
+
+  std::atomic<size_t> nextRecord(0);
+  std::atomic<int> failures(0);
+  std::mutex outputMutex;
+
+  std::vector<double> fusedSum(fuseId.empty() ? 0 : p * p, 0.0);
+  int fusedCount = 0;
+  std::mutex fusedMutex;
+
+  runWorkers(captureWorkers, [&](int) {
+    for (size_t i = nextRecord++; i < records.size(); i = nextRecord++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      nlohmann::json result;
+      result["index"] = i;
+
+      try {
+        nlohmann::json record = nlohmann::json::parse(records[i]);
+        std::string id = record.at("id").get<std::string>();
+        std::string capture = record.at("capture").get<std::string>();
+        std::string outputFilePath = "/tmp/" + id + ".json";
+        result["id"] = id;
+        result["capture"] = capture;
+        result["output"] = outputFilePath;
+
+        DetectionStats stats;
+        initStats(stats, singlePrecision);
+        setFalsePositiveRate(stats, p, fpRate, framing);
+        stats.imageWidth = cols;
+        stats.imageHeight = rows;
+        stats.regionMode = original.regionMode;
+        stats.region = original.region;
+        stats.primeSize = p;
+
+        auto captureStart = std::chrono::high_resolution_clock::now();
+        cv::Mat marked = cv::imread(capture, cv::IMREAD_COLOR), valueMarked, luma;
+        if (marked.empty()) throw std::runtime_error("unable to read capture image");
+        bool resized = marked.rows != rows || marked.cols != cols;
+        if (resized) cv::resize(marked, marked, cv::Size(cols, rows));
+        extractValue(marked, valueMarked);
+        stats.timeImageLoad = loadTime + millisecondsSince(captureStart);
+
+        alignCapture(registration, resized, original.valuePlane, valueMarked, stats);
+
+        std::vector<T> extractedMark =
+            extractDifference<T>(valueMarked, &original, original.region, p, luma, stats);
+
+        // the capture's image sized buffers are released before the
+        // correlation buffers are allocated
+        marked.release();
+        valueMarked.release();
+        luma.release();
+
+        if (!fuseId.empty()) {
+          std::lock_guard<std::mutex> lock(fusedMutex);
+          for (int j = 0; j < p * p; j++) fusedSum[j] += extractedMark[j];
+          fusedCount++;
+        }
+
+        std::vector<int> shifts;
+        detectShifts(std::move(extractedMark), p, familyWorkers, framing, stats, shifts);
+        summariseStats(stats, shifts, p);
+        stats.timeTotal = loadTime + millisecondsSince(start);
+        outputResultsFileExtended(stats, outputFilePath);
+
+        result["detected"] = stats.detected;
+        result["status"] = "ok";
+      } catch (std::exception& ex) {
+        result["status"] = "error";
+        result["error"] = ex.what();
+        failures++;
+      }
+
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cout << result.dump() << std::endl;
+    }
+  });
+
+  if (!fuseId.empty()) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string outputFilePath = "/tmp/" + fuseId + ".json";
+    nlohmann::json result;
+    result["id"] = fuseId;
+    result["output"] = outputFilePath;
+    result["fused"] = fusedCount;
+
+    if (fusedCount == 0) {
+      result["status"] = "error";
+      result["error"] = "no captures to fuse";
+      failures++;
+    } else {
+      DetectionStats stats;
+      initStats(stats, singlePrecision);
+      setFalsePositiveRate(stats, p, fpRate, framing);
+      stats.imageWidth = cols;
+      stats.imageHeight = rows;
+      stats.regionMode = original.regionMode;
+      stats.region = original.region;
+      stats.primeSize = p;
+      stats.timeImageLoad = loadTime;
+      stats.timeExtraction = 0.0;
+
+      std::vector<T> fusedMark(p * p);
+      for (int j = 0; j < p * p; j++) fusedMark[j] = (T)(fusedSum[j] / fusedCount);
+
+      std::vector<int> shifts;
+      detectShifts(std::move(fusedMark), p, workerCount, framing, stats, shifts);
+      summariseStats(stats, shifts, p);
+      stats.timeTotal = loadTime + millisecondsSince(start);
+      outputResultsFileExtended(stats, outputFilePath);
+
+      result["detected"] = stats.detected;
+      result["status"] = "ok";
+    }
+
+    std::cout << result.dump() << std::endl;
+  }
+
+  return failures > 0 ? 1 : 0;
+}
+
+int main(int argc, const char* argv[]) {
+  // Start total timer
+  auto totalStart = std::chrono::high_resolution_clock::now();
+
+  // check args have been passed in
+  // args are: unique id for db entry, file path for original image (or its
+  // .wmo sidecar, written by mark-image --sidecar), file path for marked image
+  // options:
+  //   --float        compute the transforms in single precision
+  //   --workers <n>  number of families correlated at once (default one per
+  //                  core, as many as half the available memory holds), each
+  //                  worker needs about nine p x p arrays
+  //   --framing auto|framed|legacy
+  //                  read a framed message's header family to find its length
+  //                  (framed), read families until one falls below threshold
+  //                  (legacy), or use the header when there is one (auto, the
+  //                  default)
+  //   --captures <captures.jsonl>
+  //                  detect every {"id", "capture"} record of the manifest
+  //                  against the original at file path (the only positional
+  //                  arg), converting the original once, writing
+  //                  /tmp/<id>.json and a json result line for each, with the
+  //                  workers spread across the captures
+  //   --fuse <id>    with --captures, also detect the average of the marks
+  //                  extracted from all captures, written to /tmp/<id>.json
+  //   --blind        detect without the original, args are the unique id and
+  //                  the file path for the marked image, the host image is
+  //                  suppressed by whitening the extracted mark (the
+  //                  threshold is for a false positive rate of 1e-6 unless
+  //                  --fp-rate gives one)
+  //   --register auto|on|off
+  //                  align the marked image to the original (rotation, scale
+  //                  and translation) before subtracting, always (on), never
+  //                  (off), or when its size differs from the original's
+  //                  (auto, the default)
+  //   --fp-rate <rate>
+  //                  accept a family when an unmarked image would reach its
+  //                  peak with probability below rate, instead of the fixed
+  //                  peak-to-RMS threshold of 6
+  //   --fft opencv|native|auto
+  //                  backend for the image sized transform (default opencv),
+  //                  auto measures both the first time it sees a size
+  //   --fft-wisdom <path>
+  //                  load auto's choices from (and save new ones to) this file
+  //   --region full|smooth
+  //                  the region mark-image --region marked (default full), a
+  //                  sidecar's own region takes precedence
+  std::vector<std::string> args;
+  bool singlePrecision = false;
+  int workerCount = 0;  // until --workers, workersFor picks
+  std::string framing = "auto";
+  std::string capturesManifest;
+  std::string fuseId;
+  bool blind = false;
+  std::string registration = "auto";
+  double fpRate = 0.0;
+  std::string fftBackend = "opencv";
+  std::string fftWisdom;
+  std::string regionMode = "full";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--float")
+      singlePrecision = true;
+    else if (arg == "--workers" && i + 1 < argc) {
+      if (!parseNumber(argv[++i], workerCount)) return invalidOption(arg, argv[i]);
+      workerCount = std::max(1, workerCount);
+    }
+    else if (arg == "--framing" && i + 1 < argc)
+      framing = argv[++i];
+    else if (arg == "--captures" && i + 1 < argc)
+      capturesManifest = argv[++i];
+    else if (arg == "--fuse" && i + 1 < argc)
+      fuseId = argv[++i];
+    else if (arg == "--blind")
+      blind = true;
+    else if (arg == "--register" && i + 1 < argc)
+      registration = argv[++i];
+    else if (arg == "--fp-rate" && i + 1 < argc) {
+      if (!parseNumber(argv[++i], fpRate) || fpRate < 0 || fpRate >= 1) {
+        return invalidOption(arg, argv[i]);
+      }
+    }
+    else if (arg == "--fft" && i + 1 < argc)
+      fftBackend = argv[++i];
+    else if (arg == "--fft-wisdom" && i + 1 < argc)
+      fftWisdom = argv[++i];
+    else if (arg == "--region" && i + 1 < argc)
+      regionMode = argv[++i];
+    else
+      args.push_back(arg);
+  }
+
+  if (framing != "auto" && framing != "framed" && framing != "legacy")
+    return invalidOption("--framing", framing);
+  if (registration != "auto" && registration != "on" && registration != "off")
+    return invalidOption("--register", registration);
+  if (regionMode != "full" && regionMode != "smooth") return invalidOption("--region", regionMode);
+  if (!setFftBackend(fftBackend)) return invalidOption("--fft", fftBackend);
+  if (!fftWisdom.empty() && !useFftWisdom(fftWisdom)) {
+    std::cout << "unable to read fft wisdom " << fftWisdom << std::endl;
+    return -1;
+  }
+
+  if (!capturesManifest.empty()) {
+    if (args.size() != 1 || blind) {
+      std::cout << "incorrect number of arguments" << std::endl;
+      return -1;
+    }
+    // the captures' result lines replace the progress output
+    logProgress = false;
+    if (singlePrecision)
+      return detectCaptures<float>(args[0], capturesManifest, fuseId, workerCount, framing,
+                                   registration, fpRate, regionMode);
+    return detectCaptures<double>(args[0], capturesManifest, fuseId, workerCount, framing,
+                                  registration, fpRate, regionMode);
+  }
+
+  if (args.size() != (blind ? 2 : 3)) {
+    std::cout << "incorrect number of arguments" << std::endl;
+    return -1;
+  }
+
+  std::string uid = args[0];  // the userid, used in the file path for saving results
+  std::string originalFilePath = blind ? "" : args[1];
+  std::string markedFilePath = args.back();
+  std::string outputFilePath = "/tmp/" + uid + ".json";
+
+  std::cout << "user with id " << uid << ", detecting message in marked image at " << markedFilePath
+            << std::endl;
+
+  // Initialize detection stats
+  DetectionStats stats;
+  initStats(stats, singlePrecision);
+  stats.blind = blind;
+
+  int p, imgRows, imgCols;
+  std::vector<int> shifts;
+
+  // Time image loading
+  auto loadStart = std::chrono::high_resolution_clock::now();
+
+  // read in the original (or map its sidecar) and the marked image, as 3
+  // channel BGR
+  Original original;
+  if (!blind && !loadOriginal(originalFilePath, regionMode, original)) {
+    std::cout << "unable to read original " << originalFilePath << std::endl;
+    return -1;
+  }
+  cv::Mat marked = cv::imread(markedFilePath, cv::IMREAD_COLOR);
+  if (blind && marked.empty()) {
+    std::cout << "unable to read marked image " << markedFilePath << std::endl;
+    return -1;
+  }
+
+  stats.timeImageLoad = millisecondsSince(loadStart);
+
+  std::cout << "images read in and converted to 3 channel BGR " << std::endl;
+
+  // set variables for the image rows and cols, blind detection reads the
+  // marked image at its own size
+  imgRows = blind ? marked.rows : original.valuePlane.rows;
+  imgCols = blind ? marked.cols : original.valuePlane.cols;
+
+  // check original and marked images are of equal size
+  bool resized = imgRows != marked.rows || imgCols != marked.cols;
+  if (resized) {
+    std::cout << "Original and marked images are not equal sizes. Resizing marked image to match "
+                 "original."
+              << std::endl;
+    std::cout << "Original: " << imgCols << "x" << imgRows << ", Marked: " << marked.cols << "x"
+              << marked.rows << std::endl;
+    cv::resize(marked, marked, cv::Size(imgCols, imgRows));
+  }
+
+  // Store image properties
+  stats.imageWidth = imgCols;
+  stats.imageHeight = imgRows;
+
+  // the region the mark was added to, and the largest prime for it
+  if (blind) {
+    original.regionMode = regionMode;
+    regionFor(regionMode, imgRows, imgCols, original.region);
+  }
+  stats.regionMode = original.regionMode;
+  stats.region = original.region;
+  p = blind ? largestPrimeFor(original.region.height, original.region.width) : original.p;
+  stats.primeSize = p;
+  setFalsePositiveRate(stats, p, blind && fpRate <= 0 ? kBlindFalsePositiveRate : fpRate,
+                       framing);
+
+  std::cout << "largest prime was found to be " << p << std::endl;
+
+  // subtract original luma from marked luma and store the result
+  // (the luma is the HSV value channel, V = max(B, G, R))
+  cv::Mat valueMarked;
+  extractValue(marked, valueMarked);
+
+  // line the marked image up with the original
+  if (!blind) alignCapture(registration, resized, original.valuePlane, valueMarked, stats);
+
+  // the image sized luma buffer is the largest, it is released before the
+  // correlation buffers are allocated
+  const Original* originalPlane = blind ? nullptr : &original;
+  cv::Mat luma;
+  if (singlePrecision) {
+    std::vector<float> extractedMark =
+        extractDifference<float>(valueMarked, originalPlane, original.region, p, luma, stats);
+    luma.release();
+    workerCount = workersFor(workerCount, kFamilyWorkerArrays * (size_t)p * p * sizeof(float));
+    detectShifts(std::move(extractedMark), p, workerCount, framing, stats, shifts);
+  } else {
+    std::vector<double> extractedMark =
+        extractDifference<double>(valueMarked, originalPlane, original.region, p, luma, stats);
+    luma.release();
+    workerCount = workersFor(workerCount, kFamilyWorkerArrays * (size_t)p * p * sizeof(double));
+    detectShifts(std::move(extractedMark), p, workerCount, framing, stats, shifts);
+  }
+
+  summariseStats(stats, shifts, p);
+
   // Calculate total time
-  auto totalEnd = std::chrono::high_resolution_clock::now();
-  stats.timeTotal = std::chrono::duration<double, std::milli>(totalEnd - totalStart).count();
-
-  // Clean up
-  delete[] lumaArray;
-  delete[] extractedMark;
-  delete[] wmArray;
-  delete[] correlationVals;
+  stats.timeTotal = millisecondsSince(totalStart);
 
   // Output extended results
   outputResultsFileExtended(stats, outputFilePath);
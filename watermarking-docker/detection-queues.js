@@ -63,8 +63,27 @@ module.exports = {
 
       // Download sequentially to provide clear progress for each file
       // (Parallel downloads might confuse the single status string UI)
-      await downloadFileAsync(data.pathOriginal, originalPath, 'original image', data.userId);
-      console.log('Downloaded original image.');
+      // Without an original (or with DETECT_MODE=blind) detect blind, from the
+      // marked image alone
+      const blind = !data.pathOriginal || process.env.DETECT_MODE === 'blind';
+
+      // Prefer the original's sidecar (its preprocessed value plane) when the
+      // marker wrote one, falling back to the original image
+      let haveSidecar = false;
+      if (!blind && process.env.ORIGINAL_SIDECAR) {
+        try {
+          await downloadFileAsync(data.pathOriginal + '.wmo', originalPath + '.wmo', 'original image', data.userId);
+          originalPath += '.wmo';
+          haveSidecar = true;
+          console.log('Downloaded original sidecar.');
+        } catch (sidecarErr) {
+          console.log('No original sidecar, downloading the original image.');
+        }
+      }
+      if (!blind && !haveSidecar) {
+        await downloadFileAsync(data.pathOriginal, originalPath, 'original image', data.userId);
+        console.log('Downloaded original image.');
+      }
 
       await downloadFileAsync(data.pathMarked, markedPath, 'marked image', data.userId);
       console.log('Downloaded marked image.');
@@ -76,9 +95,46 @@ module.exports = {
 
       console.log('Detecting message...');
 
+      // Detect in the region the image was marked in, as recorded when it was
+      // marked. Images marked before the region was recorded were marked over
+      // the full image, whatever MARK_REGION says now.
+      let region = 'full';
+      if (data.markedImageId) {
+        try {
+          const markedDoc = await db.collection('markedImages').doc(data.markedImageId).get();
+          if (markedDoc.exists && markedDoc.data().region) {
+            region = markedDoc.data().region;
+          }
+        } catch (regionErr) {
+          console.error('Failed to read the marked image region:', regionErr);
+        }
+      }
+
       // Run detection binary
       await new Promise((resolve, reject) => {
-        const detectProcess = spawn('./detect-wm', [taskId, originalPath, markedPath]);
+        const detectArgs = blind ? ['--blind', taskId, markedPath] : [taskId, originalPath, markedPath];
+        if (process.env.TRANSFORM_PRECISION === 'float') {
+          detectArgs.push('--float');
+        }
+        if (process.env.DETECT_WORKERS) {
+          detectArgs.push('--workers', process.env.DETECT_WORKERS);
+        }
+        if (process.env.FFT_BACKEND) {
+          detectArgs.push('--fft', process.env.FFT_BACKEND);
+        }
+        if (process.env.FFT_WISDOM) {
+          detectArgs.push('--fft-wisdom', process.env.FFT_WISDOM);
+        }
+        if (process.env.DETECT_FP_RATE) {
+          detectArgs.push('--fp-rate', process.env.DETECT_FP_RATE);
+        }
+        if (!blind && process.env.DETECT_REGISTRATION) {
+          detectArgs.push('--register', process.env.DETECT_REGISTRATION);
+        }
+        if (region) {
+          detectArgs.push('--region', region);
+        }
+        const detectProcess = spawn('./detect-wm', detectArgs);
 
         let stdout = '';
         let stderr = '';
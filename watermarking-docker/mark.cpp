@@ -6,39 +6,357 @@
 //  Copyright © 2016 ENSPYR. All rights reserved.
 //
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <opencv2/opencv.hpp>
+#include <sstream>
 
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+#include "watermarking-functions/OriginalSidecar.hpp"
+#include "watermarking-functions/Parallel.hpp"
+#include "watermarking-functions/PatternCache.hpp"
 #include "watermarking-functions/Utilities.hpp"
 #include "watermarking-functions/WatermarkDetection.hpp"
+#include "watermarking-functions/WatermarkPattern.hpp"
+#include "watermarking-functions/json.hpp"
+
+// buffers reused between the images marked by one worker
+struct MarkBuffers {
+  cv::Mat valuePlane;
+};
+
+// the patterns this process used most recently, most recent first, shared by
+// every image of a batch. A 12 MP pattern is about 48 MB, so they are kept to
+// kRecentPatternBytes (always at least the latest) and PatternCache holds the rest.
+static const size_t kRecentPatternBytes = 192 << 20;
+static std::list<std::pair<std::string, WatermarkPattern> > recentPatterns;
+static std::mutex recentPatternsMutex;
+
+// precision the transforms are computed in, CV_64F or CV_32F (--float)
+static int transformDepth = CV_64F;
+
+// add a header family carrying the digit count and a checksum (--framed)
+static bool framedMessages = false;
+
+// write <original>.wmo next to each original (--sidecar), with the extracted
+// block of its transform (--sidecar-block)
+static bool writeSidecars = false;
+static bool sidecarBlocks = false;
+
+// the region of each image the mark is added to, "full" or "smooth" (--region)
+static std::string regionMode = "full";
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
 
-int main(int argc, const char* argv[]) {
-  // check args have been passed in
-  // args are: file path, image name, message, strength
-  if (argc != 5) {
-    std::cout << "incorrect number of arguments" << std::endl;
-    return -1;
+// the region of a rows x cols image the mark is added to
+static cv::Rect markRegion(int rows, int cols) {
+  cv::Rect region;
+  regionFor(regionMode, rows, cols, region);
+  return region;
+}
+
+// the region as it is reported in a result line
+static nlohmann::json describeRegion(const cv::Rect& region) {
+  nlohmann::json described;
+  described["mode"] = regionMode;
+  described["x"] = region.x;
+  described["y"] = region.y;
+  described["width"] = region.width;
+  described["height"] = region.height;
+  return described;
+}
+
+// load the pattern for message from the cache, or compute (and cache) it
+static WatermarkPattern loadPattern(int rows, int cols, int p, const std::string& message,
+                                    int strength, PatternCache* cache) {
+  WatermarkPattern pattern;
+  if (cache != nullptr &&
+      cache->load(rows, cols, p, message, strength, framedMessages, transformDepth, pattern)) {
+    return pattern;
   }
 
-  // std::cout << "image name: " << argv[argc-3] << ", message = " <<
-  // argv[argc-2] << std::endl;
+  // combine the shifted arrays for every digit and turn them into a spatial
+  // pattern with a single inverse transform
+  std::vector<int> messageShifts = getShifts(message, p * p);
+  double* wmArray = new double[p * p];
+  combineMarks(p, messageShifts, strength, wmArray, framedMessages);
+  pattern = WatermarkPattern(rows, cols, p, p, wmArray, transformDepth);
+  delete[] wmArray;
 
-  int strength = atoi(argv[argc - 1]);
-  std::string strengthString = argv[argc - 1];
-  std::string message = argv[argc - 2];
-  std::string imageName = argv[argc - 3];
-  std::string filePath = argv[argc - 4];
+  if (cache != nullptr) {
+    cache->store(rows, cols, p, message, strength, framedMessages, transformDepth, pattern);
+  }
+  return pattern;
+}
 
-  // read in image and convert to 3 channel BGR
+// find the pattern for message among the recent patterns, or load it and keep
+// it there for the next image of the batch
+static WatermarkPattern patternFor(int rows, int cols, int p, const std::string& message,
+                                   int strength, PatternCache* cache) {
+  std::ostringstream key;
+  key << rows << "x" << cols << ":" << p << ":" << strength << ":" << framedMessages << ":"
+      << message;
+
+  {
+    std::lock_guard<std::mutex> lock(recentPatternsMutex);
+    for (auto it = recentPatterns.begin(); it != recentPatterns.end(); ++it) {
+      if (it->first != key.str()) continue;
+      recentPatterns.splice(recentPatterns.begin(), recentPatterns, it);
+      return it->second;
+    }
+  }
+
+  WatermarkPattern pattern = loadPattern(rows, cols, p, message, strength, cache);
+
+  // another worker may have computed the same pattern meanwhile
+  std::lock_guard<std::mutex> lock(recentPatternsMutex);
+  recentPatterns.remove_if([&](const std::pair<std::string, WatermarkPattern>& recent) {
+    return recent.first == key.str();
+  });
+  recentPatterns.emplace_front(key.str(), pattern);
+  size_t bytes = 0;
+  for (auto it = recentPatterns.begin(); it != recentPatterns.end(); ++it) {
+    size_t size = it->second.mat().total() * it->second.mat().elemSize();
+    if (it != recentPatterns.begin() && bytes + size > kRecentPatternBytes) {
+      recentPatterns.erase(it, recentPatterns.end());
+      break;
+    }
+    bytes += size;
+  }
+  return pattern;
+}
+
+// write the sidecar for an original at filePath, given its value plane and the
+// region it is marked in
+static void saveSidecar(const std::string& filePath, const cv::Mat& valuePlane,
+                        const cv::Rect& region, int p, nlohmann::json& timing) {
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!OriginalSidecar::write(filePath + ".wmo", valuePlane, region, p, sidecarBlocks)) {
+    throw std::runtime_error("unable to write sidecar");
+  }
+  timing["sidecar"] = millisecondsSince(start);
+}
 
+// mark a BGR image in place by adding the message's pattern to the value
+// channel of its mark region, saving the original's sidecar first when
+// filePath is given, returns the region
+static cv::Rect markImage(cv::Mat& image, const std::string& message, int strength,
+                          PatternCache* cache, MarkBuffers& buffers, nlohmann::json& timing,
+                          const std::string& filePath = "") {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  cv::Rect region = markRegion(image.rows, image.cols);
+  int p = largestPrimeFor(region.height, region.width);
+  WatermarkPattern pattern = patternFor(region.height, region.width, p, message, strength, cache);
+  timing["pattern"] = millisecondsSince(start);
+
+  // only V changes, so work on V = max(B, G, R) and rescale each pixel rather
+  // than converting the whole image to HSV and back
+  start = std::chrono::high_resolution_clock::now();
+  extractValue(image, buffers.valuePlane);
+  if (!filePath.empty()) saveSidecar(filePath, buffers.valuePlane, region, p, timing);
+  cv::Mat regionPlane = buffers.valuePlane(region);
+  pattern.applyTo(regionPlane);
+  replaceValue(image, buffers.valuePlane);
+  timing["mark"] = millisecondsSince(start);
+  return region;
+}
+
+static bool savePNG(const std::string& filePath, cv::Mat& image) {
+  // IMWRITE_PNG_COMPRESSION
+  // compression level from 0 to 9. A higher value means a smaller size and
+  // longer compression time
+
+  std::vector<int> compression_params;
+  compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+  compression_params.push_back(9);
+
+  try {
+    return imwrite(filePath, image, compression_params);
+  } catch (cv::Exception& ex) {
+    fprintf(stderr, "Exception writing out image to PNG format: %s\n", ex.what());
+    return false;
+  }
+}
+
+// the strength of a manifest record, given as a number or a string
+static int strengthOf(const nlohmann::json& record) {
+  const nlohmann::json& strength = record.at("strength");
+  return strength.is_string() ? atoi(strength.get<std::string>().c_str()) : strength.get<int>();
+}
+
+// mark one manifest record, {"input", "message", "strength", "output"}, and
+// return its result line
+static nlohmann::json markRecord(size_t index, const std::string& line, PatternCache* cache,
+                                 MarkBuffers& buffers) {
+  auto start = std::chrono::high_resolution_clock::now();
+  nlohmann::json result;
+  result["index"] = index;
+
+  try {
+    nlohmann::json record = nlohmann::json::parse(line);
+    std::string input = record.at("input").get<std::string>();
+    std::string output = record.at("output").get<std::string>();
+    std::string message = record.at("message").get<std::string>();
+    int strength = strengthOf(record);
+    result["input"] = input;
+    result["output"] = output;
+
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    cv::Mat image = cv::imread(input, cv::IMREAD_COLOR);
+    result["timing"]["load"] = millisecondsSince(loadStart);
+    if (image.empty()) throw std::runtime_error("unable to read input image");
+
+    cv::Rect region = markImage(image, message, strength, cache, buffers, result["timing"],
+                                writeSidecars ? input : "");
+    result["region"] = describeRegion(region);
+
+    auto saveStart = std::chrono::high_resolution_clock::now();
+    if (!savePNG(output, image)) throw std::runtime_error("unable to write output image");
+    result["timing"]["save"] = millisecondsSince(saveStart);
+
+    result["status"] = "ok";
+  } catch (std::exception& ex) {
+    result["status"] = "error";
+    result["error"] = ex.what();
+  }
+
+  result["timing"]["total"] = millisecondsSince(start);
+  return result;
+}
+
+// mark every record of a json lines manifest, spread across workerCount
+// threads, writing one json result line per record to stdout
+static int markBatch(const std::string& manifestPath, int workerCount, PatternCache* cache) {
+  std::vector<std::string> records;
+  if (!readManifest(manifestPath, records)) return -1;
+
+  // the records are processed in parallel, so keep OpenCV to one thread each
+  if (workerCount > 1) cv::setNumThreads(1);
+
+  std::atomic<size_t> nextRecord(0);
+  std::atomic<int> failures(0);
+  std::mutex outputMutex;
+
+  runWorkers(workerCount, [&](int) {
+    MarkBuffers buffers;
+    for (size_t i = nextRecord++; i < records.size(); i = nextRecord++) {
+      nlohmann::json result = markRecord(i, records[i], cache, buffers);
+      if (result["status"] != "ok") failures++;
+
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cout << result.dump() << std::endl;
+    }
+  });
+
+  return failures > 0 ? 1 : 0;
+}
+
+// mark one original with a different message for each recipient record,
+// {"message", "strength", "output"}. The original is decoded and its value
+// plane extracted once, then every output starts from copies of both.
+static int markFanOut(const std::string& filePath, const std::string& manifestPath,
+                      int workerCount, PatternCache* cache) {
+  std::vector<std::string> records;
+  if (!readManifest(manifestPath, records)) return -1;
+
+  auto loadStart = std::chrono::high_resolution_clock::now();
   cv::Mat original = cv::imread(filePath, cv::IMREAD_COLOR);
+  if (original.empty()) {
+    std::cout << "unable to read image " << filePath << std::endl;
+    return -1;
+  }
 
-  std::cout << "PROGRESS:loading" << std::endl;
-  std::cout.flush();
+  cv::Rect region = markRegion(original.rows, original.cols);
+  int p = largestPrimeFor(region.height, region.width);
+  cv::Mat valueOriginal;
+  extractValue(original, valueOriginal);
+  double loadTime = millisecondsSince(loadStart);
+
+  if (writeSidecars) {
+    nlohmann::json timing;
+    try {
+      saveSidecar(filePath, valueOriginal, region, p, timing);
+    } catch (std::exception& ex) {
+      std::cout << ex.what() << std::endl;
+      return -1;
+    }
+  }
 
-  // calculate the largest prime for this image
+  if (workerCount > 1) cv::setNumThreads(1);
+
+  std::atomic<size_t> nextRecord(0);
+  std::atomic<int> failures(0);
+  std::mutex outputMutex;
+
+  runWorkers(workerCount, [&](int) {
+    MarkBuffers buffers;
+    cv::Mat marked;
+    for (size_t i = nextRecord++; i < records.size(); i = nextRecord++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      nlohmann::json result;
+      result["index"] = i;
+      result["timing"]["load"] = loadTime;
+
+      try {
+        nlohmann::json record = nlohmann::json::parse(records[i]);
+        std::string output = record.at("output").get<std::string>();
+        std::string message = record.at("message").get<std::string>();
+        int strength = strengthOf(record);
+        result["output"] = output;
+        result["region"] = describeRegion(region);
+
+        // every recipient has its own message, so the pattern is dropped once
+        // it is applied rather than kept with the recent patterns
+        auto patternStart = std::chrono::high_resolution_clock::now();
+        WatermarkPattern pattern =
+            loadPattern(region.height, region.width, p, message, strength, cache);
+        result["timing"]["pattern"] = millisecondsSince(patternStart);
+
+        auto markStart = std::chrono::high_resolution_clock::now();
+        valueOriginal.copyTo(buffers.valuePlane);
+        cv::Mat regionPlane = buffers.valuePlane(region);
+        pattern.applyTo(regionPlane);
+        original.copyTo(marked);
+        replaceValue(marked, buffers.valuePlane);
+        result["timing"]["mark"] = millisecondsSince(markStart);
+
+        auto saveStart = std::chrono::high_resolution_clock::now();
+        if (!savePNG(output, marked)) throw std::runtime_error("unable to write output image");
+        result["timing"]["save"] = millisecondsSince(saveStart);
+
+        result["status"] = "ok";
+      } catch (std::exception& ex) {
+        result["status"] = "error";
+        result["error"] = ex.what();
+        failures++;
+      }
+
+      result["timing"]["total"] = millisecondsSince(start);
+
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cout << result.dump() << std::endl;
+    }
+  });
 
-  int p = largestPrimeFor(original);
+  return failures > 0 ? 1 : 0;
+}
+
+// mark a BGR image in place with one dft/idft pair per message digit (the
+// original method), computing the transforms with precision T
+template <typename T>
+static void markPerDigit(cv::Mat& original, const std::string& message, int strength) {
+  // calculate the largest prime for the region being marked
+
+  cv::Rect region = markRegion(original.rows, original.cols);
+  int p = largestPrimeFor(region.height, region.width);
 
   // convert image to HSV
 
@@ -47,19 +365,15 @@ int main(int argc, const char* argv[]) {
 
   // create a 1d array with luma values
 
-  double* lumaArray = new double[hsvImage.cols * hsvImage.rows];
-
-  for (int y = 0; y < hsvImage.rows; y++) {
-    for (int x = 0; x < hsvImage.cols; x++) {
-      lumaArray[y * hsvImage.cols + x] = hsvImage.at<cv::Vec3b>(y, x).val[2] / 255.0;
-    }
-  }
+  cv::Mat valuePlane;
+  cv::extractChannel(hsvImage, valuePlane, 2);
 
-  // create the watermark array
-
-  double* wmArray = new double[p * p];
+  cv::Mat regionPlane = valuePlane(region);
+  cv::Mat luma(region.size(), cv::DataType<T>::type);
+  planeToLuma(regionPlane, luma.ptr<T>(0));
 
-  // generate each array and mark the image
+  // generate each array and mark the image, the arrays are read element by
+  // element with the strength and message shift applied, never stored
 
   std::vector<int> messageShifts = getShifts(message, p * p);
   int totalShifts = (int)messageShifts.size();
@@ -68,54 +382,197 @@ int main(int argc, const char* argv[]) {
     std::cout << "PROGRESS:marking:" << k << ":" << totalShifts << std::endl;
     std::cout.flush();
 
-    generateArray(p, k, wmArray);
+    insertMark(LumaView<T>(luma), LegendreArray(p, k, strength, messageShifts[k - 1]));
+  }
 
-    // multiply the watermark array by the strength
+  if (framedMessages) {
+    insertMark(LumaView<T>(luma),
+               LegendreArray(p, frameHeaderFamily(p), strength, frameHeader(p, messageShifts)));
+  }
 
-    for (int i = 0; i < p * p; i++) {
-      wmArray[i] = wmArray[i] * strength;
-    }
+  // put the marked luma data back into the original image
 
-    // mark the luma data
+  lumaToPlane(luma.ptr<T>(0), regionPlane);
+  cv::insertChannel(valuePlane, hsvImage, 2);
 
-    insertMark(hsvImage.rows, hsvImage.cols, p, p, lumaArray, wmArray, messageShifts[k - 1]);
+  // convert back to BGR (required by imwrite)
+
+  cvtColor(hsvImage, original, cv::COLOR_HSV2BGR);
+}
+
+int main(int argc, const char* argv[]) {
+  // check args have been passed in
+  // args are: file path, image name, message, strength
+  // options:
+  //   --per-digit  embed each message digit with its own dft/idft pair (the
+  //                original method, kept for comparison) instead of adding a
+  //                precomputed spatial pattern
+  //   --cache-dir <dir>
+  //                reuse patterns from (and save new patterns to) a pattern
+  //                cache in this directory
+  //   --cache-budget <MB>
+  //                size the pattern cache is kept under (default 2048)
+  //   --batch <manifest.jsonl>
+  //                mark every {"input", "message", "strength", "output"} record
+  //                of the manifest instead (no positional args), writing a json
+  //                result line for each
+  //   --fanout <recipients.jsonl>
+  //                mark the image at file path (the only positional arg) once
+  //                for every {"message", "strength", "output"} record, sharing
+  //                the decode and colour conversion, writing a json result
+  //                line for each
+  //   --workers <n>
+  //                number of records marked at once (default one per core)
+  //   --framed     add a header family with the digit count and a checksum,
+  //                so detection knows the message length (legacy detectors
+  //                still read framed messages)
+  //   --float      compute the transforms in single precision (patterns are
+  //                stored as float either way, so this only saves time and
+  //                memory while a new pattern is computed, and the cache
+  //                keeps float and double patterns apart)
+  //   --sidecar    also write <file path>.wmo, the original's value plane
+  //                preprocessed for detect-wm (for every input in batch mode)
+  //   --sidecar-block
+  //                include the p x p block of the original's transform in the
+  //                sidecar, so double precision detection skips the plane
+  //   --fft opencv|native|auto
+  //                backend for the image sized transforms (default opencv),
+  //                auto measures both the first time it sees a size
+  //   --fft-wisdom <path>
+  //                load auto's choices from (and save new ones to) this file
+  //   --region full|smooth
+  //                mark the whole image (full, the default), or the centred
+  //                region whose sides are the largest 2-3-5 smooth sizes that
+  //                fit (smooth), so the transform time doesn't depend on the
+  //                factors of the image's size. detect-wm must be given the
+  //                same mode (a sidecar records it)
+  std::vector<std::string> args;
+  bool perDigit = false;
+  std::string cacheDir;
+  size_t cacheBudgetMB = 2048;
+  std::string batchManifest;
+  std::string fanOutManifest;
+  int workerCount = defaultWorkerCount();
+  std::string fftBackend = "opencv";
+  std::string fftWisdom;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--per-digit") {
+      perDigit = true;
+    } else if (arg == "--cache-dir" && i + 1 < argc) {
+      cacheDir = argv[++i];
+    } else if (arg == "--cache-budget" && i + 1 < argc) {
+      int budget;
+      if (!parseNumber(argv[++i], budget) || budget < 0) return invalidOption(arg, argv[i]);
+      cacheBudgetMB = budget;
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batchManifest = argv[++i];
+    } else if (arg == "--fanout" && i + 1 < argc) {
+      fanOutManifest = argv[++i];
+    } else if (arg == "--workers" && i + 1 < argc) {
+      if (!parseNumber(argv[++i], workerCount)) return invalidOption(arg, argv[i]);
+      workerCount = std::max(1, workerCount);
+    } else if (arg == "--framed") {
+      framedMessages = true;
+    } else if (arg == "--float") {
+      transformDepth = CV_32F;
+    } else if (arg == "--sidecar") {
+      writeSidecars = true;
+    } else if (arg == "--sidecar-block") {
+      writeSidecars = true;
+      sidecarBlocks = true;
+    } else if (arg == "--fft" && i + 1 < argc) {
+      fftBackend = argv[++i];
+    } else if (arg == "--fft-wisdom" && i + 1 < argc) {
+      fftWisdom = argv[++i];
+    } else if (arg == "--region" && i + 1 < argc) {
+      regionMode = argv[++i];
+    } else {
+      args.push_back(arg);
+    }
   }
 
-  // put the marked luma data back into the original image
+  if (!setFftBackend(fftBackend)) return invalidOption("--fft", fftBackend);
+  if (regionMode != "full" && regionMode != "smooth") return invalidOption("--region", regionMode);
+  if (!fftWisdom.empty() && !useFftWisdom(fftWisdom)) {
+    std::cout << "unable to read fft wisdom " << fftWisdom << std::endl;
+    return -1;
+  }
 
-  for (int y = 0; y < hsvImage.rows; y++) {
-    for (int x = 0; x < hsvImage.cols; x++) {
-      float lumaValue = lumaArray[y * hsvImage.cols + x] * 255.0;
+  PatternCache cache(cacheDir, cacheBudgetMB * 1024 * 1024);
+  PatternCache* patternCache = cacheDir.empty() ? nullptr : &cache;
 
-      if (lumaValue > 255.0)
-        hsvImage.at<cv::Vec3b>(y, x).val[2] = 255;
-      else if (lumaValue < 0.0)
-        hsvImage.at<cv::Vec3b>(y, x).val[2] = 0;
-      else {
-        hsvImage.at<cv::Vec3b>(y, x).val[2] = (int)(round(lumaValue));
-      }
+  if (!batchManifest.empty()) {
+    return markBatch(batchManifest, workerCount, patternCache);
+  }
+
+  if (!fanOutManifest.empty()) {
+    if (args.size() != 1) {
+      std::cout << "incorrect number of arguments" << std::endl;
+      return -1;
     }
+    return markFanOut(args[0], fanOutManifest, workerCount, patternCache);
   }
 
-  // convert back to BGR (required by imwrite)
+  if (args.size() != 4) {
+    std::cout << "incorrect number of arguments" << std::endl;
+    return -1;
+  }
 
-  cvtColor(hsvImage, original, cv::COLOR_HSV2BGR);
+  // std::cout << "image name: " << args[1] << ", message = " <<
+  // args[2] << std::endl;
 
-  // IMWRITE_PNG_COMPRESSION
-  // compression level from 0 to 9. A higher value means a smaller size and
-  // longer compression time
+  int strength = atoi(args[3].c_str());
+  std::string strengthString = args[3];
+  std::string message = args[2];
+  std::string imageName = args[1];
+  std::string filePath = args[0];
 
-  std::cout << "PROGRESS:saving" << std::endl;
-  std::cout.flush();
+  // read in image and convert to 3 channel BGR
 
-  std::vector<int> compression_params;
-  compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-  compression_params.push_back(9);
+  cv::Mat original = cv::imread(filePath, cv::IMREAD_COLOR);
+
+  std::cout << "PROGRESS:loading" << std::endl;
+  std::cout.flush();
 
   try {
-    imwrite(filePath + "-marked.png", original, compression_params);
-  } catch (cv::Exception& ex) {
-    fprintf(stderr, "Exception writing out image to PNG format: %s\n", ex.what());
+    if (perDigit && writeSidecars) {
+      cv::Mat valueOriginal;
+      extractValue(original, valueOriginal);
+      nlohmann::json timing;
+      cv::Rect region = markRegion(original.rows, original.cols);
+      saveSidecar(filePath, valueOriginal, region, largestPrimeFor(region.height, region.width),
+                  timing);
+    }
+  } catch (std::exception& ex) {
+    std::cout << ex.what() << std::endl;
+    return 1;
+  }
+
+  if (perDigit) {
+    if (transformDepth == CV_32F)
+      markPerDigit<float>(original, message, strength);
+    else
+      markPerDigit<double>(original, message, strength);
+  } else {
+    std::cout << "PROGRESS:marking:1:1" << std::endl;
+    std::cout.flush();
+
+    MarkBuffers buffers;
+    nlohmann::json timing;
+    try {
+      markImage(original, message, strength, patternCache, buffers, timing,
+                writeSidecars ? filePath : "");
+    } catch (std::exception& ex) {
+      std::cout << ex.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "PROGRESS:saving" << std::endl;
+  std::cout.flush();
+
+  if (!savePNG(filePath + "-marked.png", original)) {
     return 1;
   }
 
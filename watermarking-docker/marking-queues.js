@@ -41,12 +41,47 @@ async function updateProgress(markedImageId, progress) {
 // Run mark-image binary with real-time progress updates
 function runMarkImageWithProgress(filePath, imageName, message, strength, markedImageId) {
   return new Promise((resolve, reject) => {
-    const child = spawn('./mark-image', [
-      filePath,
-      imageName,
-      message,
-      String(strength)
-    ]);
+    const args = [filePath, imageName, message, String(strength)];
+
+    // Reuse precomputed watermark patterns across tasks when a cache is configured
+    if (process.env.PATTERN_CACHE_DIR) {
+      args.push('--cache-dir', process.env.PATTERN_CACHE_DIR);
+      if (process.env.PATTERN_CACHE_BUDGET_MB) {
+        args.push('--cache-budget', process.env.PATTERN_CACHE_BUDGET_MB);
+      }
+    }
+
+    // Frame messages with a length and checksum header when configured
+    if (process.env.MESSAGE_FRAMING === 'framed') {
+      args.push('--framed');
+    }
+
+    // Compute the transforms in single precision when configured
+    if (process.env.TRANSFORM_PRECISION === 'float') {
+      args.push('--float');
+    }
+
+    // Write a preprocessed original (.wmo) for detection when configured
+    if (process.env.ORIGINAL_SIDECAR === 'block') {
+      args.push('--sidecar-block');
+    } else if (process.env.ORIGINAL_SIDECAR) {
+      args.push('--sidecar');
+    }
+
+    // Choose the transform backend (and its wisdom file) when configured
+    if (process.env.FFT_BACKEND) {
+      args.push('--fft', process.env.FFT_BACKEND);
+    }
+    if (process.env.FFT_WISDOM) {
+      args.push('--fft-wisdom', process.env.FFT_WISDOM);
+    }
+
+    // Mark the 2-3-5 smooth region rather than the whole image when configured
+    if (process.env.MARK_REGION) {
+      args.push('--region', process.env.MARK_REGION);
+    }
+
+    const child = spawn('./mark-image', args);
 
     let markingStartTime = 0;
     let currentMarkingStatus = '';
@@ -163,6 +198,16 @@ module.exports = {
       console.log('Uploading marked image to:', markedGcsPath);
       await uploadFileAsync(markedFilePath, markedGcsPath);
 
+      // Upload the original's sidecar next to the original, detection uses it
+      // in place of decoding the original
+      if (process.env.ORIGINAL_SIDECAR) {
+        try {
+          await uploadFileAsync(filePath + '.wmo', data.path + '.wmo');
+        } catch (sidecarErr) {
+          console.error('Failed to upload original sidecar:', sidecarErr);
+        }
+      }
+
       // Step 4: Get signed URL (valid for 10 years)
       await updateProgress(data.markedImageId, 'Generating URL...');
       var servingUrl = await storageHelper.getSignedUrl(markedGcsPath);
@@ -173,7 +218,9 @@ module.exports = {
         path: markedGcsPath,
         servingUrl: servingUrl,
         progress: null,
-        processedAt: new Date()
+        processedAt: new Date(),
+        // detection marks out the same region
+        region: process.env.MARK_REGION || 'full'
       });
 
       console.log('Marking task completed successfully');
@@ -0,0 +1,167 @@
+// The native backend against cv::dft: forward and inverse transforms, the
+// pruned block transform and strided regions, over prime, odd and even sizes
+// in both precisions. Then auto: its choices are recorded in the wisdom file
+// (--fft-wisdom), and a file's choices are used without measuring again.
+
+#include <opencv2/opencv.hpp>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/NativeFft.hpp"
+#include "watermarking-functions/Utilities.hpp"
+
+namespace {
+
+struct Size2d {
+  int rows;
+  int cols;
+};
+
+// primes (37 and up are past the largest butterfly, so Bluestein), odd
+// composites and even sizes, with more columns than a panel holds
+const Size2d kSizes[] = {{7, 11},  {13, 13}, {37, 41},  {61, 67},  {9, 15},   {45, 75},
+                         {63, 99}, {8, 8},   {16, 12},  {64, 48},  {90, 120}, {33, 64},
+                         {64, 33}, {2, 2},   {101, 50}, {50, 101}};
+
+cv::Mat randomMatrix(int rows, int cols, int depth) {
+  cv::Mat mat(rows, cols, depth);
+  cv::randu(mat, -1.0, 1.0);
+  return mat;
+}
+
+cv::Mat transformed(const std::string& backend, const cv::Mat& input, bool inverse) {
+  setFftBackend(backend);
+  cv::Mat mat = input.clone();
+  realDft(mat, inverse);
+  return mat;
+}
+
+void checkSize(const Size2d& size, int depth) {
+  double tolerance = depth == CV_64F ? 1e-10 : 1e-4;
+  cv::Mat input = randomMatrix(size.rows, size.cols, depth);
+
+  // forward, and inverse (any real matrix is a CCS packed spectrum)
+  cv::Mat expected = transformed("opencv", input, false);
+  cv::Mat native = transformed("native", input, false);
+  CHECK_CLOSE(native, expected, tolerance);
+
+  cv::Mat expectedInverse = transformed("opencv", input, true);
+  cv::Mat nativeInverse = transformed("native", input, true);
+  CHECK_CLOSE(nativeInverse, expectedInverse, tolerance);
+
+  // the round trip gives the input back
+  cv::Mat roundTrip = transformed("native", native, true);
+  CHECK_CLOSE(roundTrip, input, tolerance);
+
+  // the block extraction reads, for the largest prime that fits
+  if (std::min(size.rows, size.cols) >= 4) {
+    int p = largestPrimeFor(size.rows, size.cols);
+    cv::Mat mat = input.clone(), block(p, p, depth);
+    setFftBackend("native");
+    realDftBlock(mat, block);
+    cv::Mat expectedBlock = expected(cv::Rect(1, 1, p, p)).clone();
+    CHECK_CLOSE(block, expectedBlock, tolerance);
+  }
+
+  // a region of a larger matrix is transformed in place, its surroundings
+  // left alone
+  cv::Mat outer = randomMatrix(size.rows + 5, size.cols + 7, depth);
+  cv::Mat outerBefore = outer.clone();
+  cv::Rect region(3, 2, size.cols, size.rows);
+  input.copyTo(outer(region));
+  cv::Mat view = outer(region);
+  setFftBackend("native");
+  realDft(view, false);
+  cv::Mat viewResult = view.clone();
+  CHECK_CLOSE(viewResult, expected, tolerance);
+  expected.copyTo(outerBefore(region));
+  CHECK(relativeError(outer, outerBefore) <= tolerance);
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream in(path.c_str());
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// auto measures a transform it has no wisdom for and records its choice, one
+// line per transform, keeping the lines already in the file
+void checkAutoRecords(const std::string& path) {
+  std::ofstream(path.c_str()) << "7 11 64F forward native\n";
+  CHECK(useFftWisdom(path));
+  setFftBackend("auto");
+
+  cv::Mat input = randomMatrix(45, 75, CV_64F);
+  cv::Mat mat = input.clone();
+  realDft(mat);
+  CHECK_CLOSE(mat, transformed("opencv", input, false), 1e-10);
+  setFftBackend("auto");
+  realDft(mat, true);
+  CHECK_CLOSE(mat, input, 1e-10);
+
+  std::string wisdom = readFile(path);
+  CHECK(wisdom.find("7 11 64F forward native\n") != std::string::npos);
+  bool forward = wisdom.find("45 75 64F forward opencv\n") != std::string::npos ||
+                 wisdom.find("45 75 64F forward native\n") != std::string::npos;
+  bool inverse = wisdom.find("45 75 64F inverse opencv\n") != std::string::npos ||
+                 wisdom.find("45 75 64F inverse native\n") != std::string::npos;
+  CHECK(forward && inverse);
+  CHECK(std::count(wisdom.begin(), wisdom.end(), '\n') == 3);
+}
+
+// a file's choices are loaded and used as they are: no measuring (which would
+// run the native plan, and rewrite the file), and only the named backend runs.
+// The sizes are larger than any run before, so a native run grows its scratch.
+void checkAutoReloads(const std::string& path) {
+  std::string wisdom = "131 157 64F forward opencv\n157 131 64F forward native\n";
+  std::ofstream(path.c_str()) << wisdom;
+  CHECK(useFftWisdom(path));
+  setFftBackend("auto");
+
+  cv::Mat input = randomMatrix(131, 157, CV_64F), mat = input.clone();
+  size_t before = nativeFftAllocations();
+  realDft(mat);
+  CHECK(nativeFftAllocations() == before);
+  CHECK_CLOSE(mat, transformed("opencv", input, false), 1e-10);
+
+  setFftBackend("auto");
+  input = randomMatrix(157, 131, CV_64F);
+  mat = input.clone();
+  before = nativeFftAllocations();
+  realDft(mat);
+  CHECK(nativeFftAllocations() > before);
+  CHECK_CLOSE(mat, transformed("opencv", input, false), 1e-10);
+  CHECK(readFile(path) == wisdom);
+}
+
+}  // namespace
+
+int main() {
+  cv::setRNGSeed(7);
+  for (const Size2d& size : kSizes) {
+    checkSize(size, CV_64F);
+    checkSize(size, CV_32F);
+  }
+
+  char directory[] = "/tmp/fft-wisdom-test-XXXXXX";
+  if (mkdtemp(directory) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string recorded = std::string(directory) + "/recorded";
+  std::string reloaded = std::string(directory) + "/reloaded";
+  checkAutoRecords(recorded);
+  checkAutoReloads(reloaded);
+  unlink(recorded.c_str());
+  unlink(reloaded.c_str());
+  unlink((recorded + ".lock").c_str());
+  rmdir(directory);
+  return testResult();
+}
@@ -0,0 +1,54 @@
+// LegendreSpectrum's closed form against cv::dft of the array generateArray
+// builds, for primes p = 1 and p = 3 mod 4 (the Gauss sum is real for one and
+// imaginary for the other), over families from 0 to past p, in both
+// precisions.
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/LegendreSpectrum.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+
+namespace {
+
+const int kPrimes[] = {3, 5, 7, 11, 13, 29, 31, 101, 103, 127, 467};
+
+// the full complex spectrum of generateArray(p, k), transformed by cv::dft
+cv::Mat transformedArray(int p, int k) {
+  cv::Mat array(p, p, CV_64F);
+  generateArray(p, k, array.ptr<double>(0));
+  cv::Mat spectrum;
+  cv::dft(array, spectrum, cv::DFT_COMPLEX_OUTPUT);
+  return spectrum;
+}
+
+void checkFamily(const LegendreSpectrum& legendre, int p, int k) {
+  cv::Mat expected = transformedArray(p, k);
+
+  cv::Mat spectrum;
+  legendre.spectrumFor(k, spectrum);
+  CHECK(spectrum.type() == CV_64FC2);
+  CHECK_CLOSE(spectrum, expected, 1e-10);
+
+  cv::Mat floatSpectrum, floatExpected;
+  legendre.spectrumFor(k, floatSpectrum, CV_32F);
+  CHECK(floatSpectrum.type() == CV_32FC2);
+  expected.convertTo(floatExpected, CV_32F);
+  CHECK_CLOSE(floatSpectrum, floatExpected, 1e-5);
+}
+
+}  // namespace
+
+int main() {
+  for (int p : kPrimes) {
+    LegendreSpectrum legendre(p);
+    // k = 0 is the unsheared array, p - 1 the framed header family, and
+    // families past p wrap around
+    const int families[] = {0, 1, 2, (p - 1) / 2, p - 1, p, p + 3};
+    for (int k : families) checkFamily(legendre, p, k);
+  }
+  return testResult();
+}
@@ -0,0 +1,172 @@
+// The luma kernels with each instruction set the CPU has, bit for bit against
+// the scalar loops mark-image and detect-wm used before them: every 8-bit
+// value and every pair of values, and luma values on either side of each
+// rounding boundary, in rows of every length up to a few vectors (so each
+// vector width and its scalar tail are exercised).
+
+#include <opencv2/opencv.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+
+namespace {
+
+const char* kInstructionSets[] = {"scalar", "sse4.1", "avx2"};
+
+// the loops the kernels replaced
+
+template <typename T>
+void referencePlaneToLuma(const cv::Mat& plane, std::vector<T>& luma) {
+  luma.resize(plane.total());
+  for (int y = 0; y < plane.rows; y++)
+    for (int x = 0; x < plane.cols; x++)
+      luma[y * plane.cols + x] = plane.at<uchar>(y, x) / T(255.0);
+}
+
+template <typename T>
+void referenceDifferenceToLuma(const cv::Mat& marked, const cv::Mat& original,
+                               std::vector<T>& luma) {
+  luma.resize(marked.total());
+  for (int y = 0; y < marked.rows; y++)
+    for (int x = 0; x < marked.cols; x++)
+      luma[y * marked.cols + x] = (marked.at<uchar>(y, x) - original.at<uchar>(y, x)) / T(255.0);
+}
+
+template <typename T>
+void referenceLumaToPlane(const std::vector<T>& luma, cv::Mat& plane) {
+  for (int y = 0; y < plane.rows; y++) {
+    for (int x = 0; x < plane.cols; x++) {
+      float lumaValue = luma[y * plane.cols + x] * 255.0;
+
+      if (lumaValue > 255.0)
+        plane.at<uchar>(y, x) = 255;
+      else if (lumaValue < 0.0)
+        plane.at<uchar>(y, x) = 0;
+      else
+        plane.at<uchar>(y, x) = (uchar)(int)round(lumaValue);
+    }
+  }
+}
+
+template <typename T>
+bool sameBits(const std::vector<T>& a, const std::vector<T>& b) {
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+bool samePlane(const cv::Mat& a, const cv::Mat& b) {
+  return a.size() == b.size() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+// lay values out in rows of cols, padding the last row with the first values
+template <typename T>
+cv::Mat rowsOf(const std::vector<T>& values, int cols, std::vector<T>& laidOut) {
+  int rows = (int)((values.size() + cols - 1) / cols);
+  laidOut.resize((size_t)rows * cols);
+  for (size_t i = 0; i < laidOut.size(); i++) laidOut[i] = values[i % values.size()];
+  return cv::Mat(rows, cols, cv::DataType<T>::type, laidOut.data());
+}
+
+// every 8-bit value, to and from luma
+template <typename T>
+void checkPlaneToLuma(int cols) {
+  std::vector<uchar> values(256);
+  for (int v = 0; v < 256; v++) values[v] = (uchar)v;
+  std::vector<uchar> laidOut;
+  cv::Mat plane = rowsOf(values, cols, laidOut);
+
+  std::vector<T> expected, luma(plane.total());
+  referencePlaneToLuma(plane, expected);
+  planeToLuma(plane, luma.data());
+  CHECK(sameBits(luma, expected));
+}
+
+// every (marked, original) pair
+template <typename T>
+void checkDifferenceToLuma(int cols) {
+  std::vector<uchar> markedValues(256 * 256), originalValues(256 * 256);
+  for (int i = 0; i < 256 * 256; i++) {
+    markedValues[i] = (uchar)(i % 256);
+    originalValues[i] = (uchar)(i / 256);
+  }
+  std::vector<uchar> markedLaidOut, originalLaidOut;
+  cv::Mat marked = rowsOf(markedValues, cols, markedLaidOut);
+  cv::Mat original = rowsOf(originalValues, cols, originalLaidOut);
+
+  std::vector<T> expected, luma(marked.total());
+  referenceDifferenceToLuma(marked, original, expected);
+  planeDifferenceToLuma(marked, original, luma.data());
+  CHECK(sameBits(luma, expected));
+}
+
+// luma values a few ulps either side of each k / 255 and (k + 0.5) / 255, of
+// the scaled values either side of k + 0.5, and out of range
+template <typename T>
+std::vector<T> boundaryLuma() {
+  std::vector<T> values;
+  for (int k = -2; k <= 257; k++) {
+    const double centres[] = {k / 255.0, (k + 0.5) / 255.0};
+    for (double centre : centres) {
+      T value = (T)centre;
+      for (int ulp = 0; ulp < 4; ulp++) value = std::nextafter(value, T(-10));
+      for (int ulp = 0; ulp <= 8; ulp++) {
+        values.push_back(value);
+        value = std::nextafter(value, T(10));
+      }
+    }
+    // the product with 255 rounds to float before rounding to 8 bits, so
+    // also the floats either side of k + 0.5 divided back down
+    float scaled = std::nextafter(std::nextafter(k + 0.5f, -1000.0f), -1000.0f);
+    for (int ulp = 0; ulp <= 4; ulp++) {
+      values.push_back((T)(scaled / 255.0));
+      scaled = std::nextafter(scaled, 1000.0f);
+    }
+  }
+  const double extremes[] = {-1e30, -1.0, -1e-12, -0.0, 1e-12, 1.0 + 1e-12, 2.0, 1e30};
+  for (double extreme : extremes) values.push_back((T)extreme);
+  values.push_back(std::numeric_limits<T>::infinity());
+  values.push_back(-std::numeric_limits<T>::infinity());
+  return values;
+}
+
+template <typename T>
+void checkLumaToPlane(int cols) {
+  std::vector<T> laidOut;
+  cv::Mat lumaMat = rowsOf(boundaryLuma<T>(), cols, laidOut);
+
+  cv::Mat expected(lumaMat.rows, cols, CV_8U), plane(lumaMat.rows, cols, CV_8U);
+  referenceLumaToPlane(laidOut, expected);
+  lumaToPlane(laidOut.data(), plane);
+  CHECK(samePlane(plane, expected));
+}
+
+}  // namespace
+
+int main() {
+  for (const char* name : kInstructionSets) {
+    std::string inUse = useLumaKernels(name);
+    if (inUse != name) {
+      printf("%s: not supported by this CPU, skipped\n", name);
+      continue;
+    }
+
+    for (int cols = 1; cols <= 40; cols++) {
+      checkPlaneToLuma<double>(cols);
+      checkPlaneToLuma<float>(cols);
+      checkLumaToPlane<double>(cols);
+      checkLumaToPlane<float>(cols);
+    }
+    const int pairWidths[] = {1, 3, 4, 7, 8, 9, 17, 256, 1021};
+    for (int cols : pairWidths) {
+      checkDifferenceToLuma<double>(cols);
+      checkDifferenceToLuma<float>(cols);
+    }
+  }
+  return testResult();
+}
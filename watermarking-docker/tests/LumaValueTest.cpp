@@ -0,0 +1,109 @@
+// extractValue and replaceValue against the HSV round trip they replaced, over
+// every 24-bit colour: the value is exactly cvtColor's V channel, and a new
+// value gives the colour the round trip gives, less the quantisation of 8-bit
+// hue and saturation.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+
+namespace {
+
+// every BGR colour once, 4096 x 4096
+cv::Mat everyColour() {
+  cv::Mat image(4096, 4096, CV_8UC3);
+  for (int i = 0; i < (1 << 24); i++) {
+    uchar* bgr = image.ptr<uchar>(i >> 12) + (i & 4095) * 3;
+    bgr[0] = (uchar)(i & 255);
+    bgr[1] = (uchar)((i >> 8) & 255);
+    bgr[2] = (uchar)(i >> 16);
+  }
+  return image;
+}
+
+// the value plane shifted by shift, saturated to [0, 255]
+cv::Mat shifted(const cv::Mat& value, int shift) {
+  cv::Mat result(value.size(), CV_8U);
+  for (int y = 0; y < value.rows; y++)
+    for (int x = 0; x < value.cols; x++)
+      result.at<uchar>(y, x) = cv::saturate_cast<uchar>(value.at<uchar>(y, x) + shift);
+  return result;
+}
+
+// the image with its value replaced the way mark-image used to: through HSV
+cv::Mat replacedThroughHsv(const cv::Mat& hsv, const cv::Mat& value) {
+  cv::Mat replaced = hsv.clone();
+  for (int y = 0; y < hsv.rows; y++)
+    for (int x = 0; x < hsv.cols; x++) replaced.ptr<uchar>(y)[x * 3 + 2] = value.at<uchar>(y, x);
+  cv::Mat bgr;
+  cv::cvtColor(replaced, bgr, cv::COLOR_HSV2BGR);
+  return bgr;
+}
+
+}  // namespace
+
+int main() {
+  cv::Mat image = everyColour();
+  cv::Mat hsv;
+  cv::cvtColor(image, hsv, cv::COLOR_BGR2HSV);
+
+  // V = max(B, G, R) is exactly cvtColor's V
+  cv::Mat value;
+  extractValue(image, value);
+  long valueMismatches = 0;
+  for (int y = 0; y < image.rows; y++)
+    for (int x = 0; x < image.cols; x++)
+      valueMismatches += value.at<uchar>(y, x) != hsv.ptr<uchar>(y)[x * 3 + 2];
+  CHECK(valueMismatches == 0);
+
+  // the same value leaves every pixel as it was
+  cv::Mat unchanged = image.clone();
+  replaceValue(unchanged, value);
+  CHECK(cv::norm(unchanged, image, cv::NORM_INF) == 0);
+
+  // the marks are a few levels either way, the larger shifts saturate
+  const int shifts[] = {-40, -3, -1, 1, 3, 40};
+  for (int shift : shifts) {
+    cv::Mat newValue = shifted(value, shift);
+    cv::Mat replaced = image.clone();
+    replaceValue(replaced, newValue);
+    cv::Mat expected = replacedThroughHsv(hsv, newValue);
+
+    // the new V is exact, and each channel is within what one step of 8-bit
+    // hue (2 degrees, 1/30 of a 60 degree sector, so up to V' / 30) and the
+    // rounding of saturation and of the channels move it
+    long wrongValues = 0, outOfBound = 0;
+    int worst = 0;
+    for (int y = 0; y < image.rows; y++) {
+      for (int x = 0; x < image.cols; x++) {
+        const uchar* actual = replaced.ptr<uchar>(y) + x * 3;
+        const uchar* roundTrip = expected.ptr<uchar>(y) + x * 3;
+        int v = newValue.at<uchar>(y, x);
+        wrongValues += std::max(actual[0], std::max(actual[1], actual[2])) != v;
+        for (int c = 0; c < 3; c++) {
+          int difference = std::abs(actual[c] - roundTrip[c]);
+          worst = std::max(worst, difference);
+          outOfBound += difference > v / 30.0 + 2;
+        }
+      }
+    }
+    printf("shift %+d: largest channel difference from the HSV round trip %d\n", shift, worst);
+    CHECK(wrongValues == 0);
+    CHECK(outOfBound == 0);
+  }
+
+  // black has no hue, a new value makes it the same grey HSV does
+  cv::Mat black = cv::Mat::zeros(1, 256, CV_8UC3), greys(1, 256, CV_8U), blackHsv;
+  for (int v = 0; v < 256; v++) greys.at<uchar>(0, v) = (uchar)v;
+  cv::cvtColor(black, blackHsv, cv::COLOR_BGR2HSV);
+  cv::Mat expectedGreys = replacedThroughHsv(blackHsv, greys);
+  replaceValue(black, greys);
+  CHECK(cv::norm(black, expectedGreys, cv::NORM_INF) == 0);
+
+  return testResult();
+}
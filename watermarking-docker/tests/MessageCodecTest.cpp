@@ -0,0 +1,216 @@
+// encodeMessage and decodeMessage (and getShifts and getASCII, which call
+// them) against the cpp_int getShifts and getASCII they replaced, kept here as
+// the reference: random messages and random digit strings for the array sizes
+// of primes from 3 to 6007, and the decoding of each message's digits. Then
+// the largest payload, timed (the conversions are O(n^2) in the digits), and
+// half of it, which should take about a quarter as long.
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/MessageCodec.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+
+namespace {
+
+typedef boost::multiprecision::cpp_int BigInt;
+
+const int kPrimes[] = {3, 5, 7, 11, 113, 467, 953, 1531, 2971, 4001, 6007};
+
+// the largest p whose array size p^2 fits an int
+const int kLargestPrime = 46337;
+
+// the original getShifts, less its commented out printing (the message must
+// not be empty)
+std::vector<int> referenceShifts(const std::string& ascii, int arraySize) {
+  std::vector<int> bits;
+  std::vector<int> shifts;
+
+  // convert ASCII to an array of bits (base 2)
+  unsigned char c;
+  for (unsigned char_num = 0; char_num < ascii.length(); char_num++) {
+    c = ascii.at(char_num);
+    for (int shift = 6; shift >= 0; shift--) {
+      bits.push_back(c >> shift & 1);
+    }
+  }
+
+  // convert array of bits (base 2) to base 10
+  BigInt big_int_total = bits.front();
+  BigInt big_int_num;
+  for (int bit_num = 1; bit_num < (int)bits.size(); bit_num++) {
+    big_int_num = 2;
+    int bit = bits.at(bit_num);
+    if (bit == 1) {
+      for (int i = 1; i < bit_num; i++) {
+        big_int_num *= 2;
+      }
+      big_int_total += big_int_num;
+    }
+  }
+
+  // convert base 10 to shifts (base arraySize)
+  BigInt n = big_int_total;
+  BigInt z;
+  while (n > 0) {
+    z = n % arraySize;
+    int messageDigit = z.convert_to<int>();
+    shifts.push_back(messageDigit);
+    n = n / arraySize;
+  }
+
+  return shifts;
+}
+
+// the original getASCII, less its printing (there must be at least one digit)
+std::string referenceASCII(const std::vector<int>& shifts, int arraySize) {
+  BigInt n, z;
+
+  // convert base array-size to base 10 (store in n)
+  std::vector<int> bits;
+  n = shifts.front();
+  for (int shiftDigitNum = 1; shiftDigitNum < (int)shifts.size(); shiftDigitNum++) {
+    z = shifts.at(shiftDigitNum);
+    for (int i = 0; i < shiftDigitNum; i++) {
+      z *= arraySize;
+    }
+    n += z;
+  }
+
+  // convert base 10 to base 2 and store as an array of bits
+  while (n > 0) {
+    z = n % 2;
+    bits.push_back(z.convert_to<int>());
+    n = n / 2;
+  }
+
+  // add any trailing zeros that were lost in the conversion
+  unsigned long numMissingBits = bits.size() / 7;
+  while (numMissingBits > 0) {
+    bits.push_back(0);
+    numMissingBits--;
+  }
+
+  // convert the array of bits to ASCII
+  int char_count = 0, bit;
+  unsigned char char_sum = 0;
+  std::string messageStr;
+  while (bits.size() > 0) {
+    bit = bits.front();
+    char_sum += bit * pow(2, 6 - char_count);
+    bits.erase(bits.begin());  // remove first element
+    char_count++;
+    char_count %= 7;
+    if (char_count == 0) {
+      messageStr.append(1, char_sum);
+      char_sum = 0;
+    }
+  }
+
+  return messageStr;
+}
+
+// a message of length characters, printable or (with anyByte) any byte, the
+// codec reading only the low 7 bits of each
+std::string randomMessage(std::mt19937& random, int length, bool anyByte) {
+  std::uniform_int_distribution<int> printable(32, 126), byte(0, 255);
+  std::string message;
+  for (int i = 0; i < length; i++) message += (char)(anyByte ? byte(random) : printable(random));
+  return message;
+}
+
+void checkMessage(const std::string& message, int arraySize) {
+  std::vector<int> expected = referenceShifts(message, arraySize);
+  std::vector<int> digits = encodeMessage(message, arraySize);
+  CHECK(digits == expected);
+  CHECK(getShifts(message, arraySize) == expected);
+
+  if (!expected.empty()) {
+    std::string decoded = decodeMessage(digits, arraySize);
+    CHECK(decoded == referenceASCII(expected, arraySize));
+    CHECK(getASCII(digits, arraySize) == decoded);
+  }
+}
+
+void checkDigits(const std::vector<int>& digits, int arraySize) {
+  CHECK(decodeMessage(digits, arraySize) == referenceASCII(digits, arraySize));
+}
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// a message filling digitCount digits at p = kLargestPrime (too long for the
+// reference, which is cubic) round trips, in the time printed
+void checkLargePayload(std::mt19937& random, int digitCount) {
+  int arraySize = kLargestPrime * kLargestPrime;
+  int length = (int)(digitCount * std::log2((double)arraySize) / 7) - 1;
+  std::string message = randomMessage(random, length, false);
+
+  auto encodeStart = std::chrono::high_resolution_clock::now();
+  std::vector<int> digits = encodeMessage(message, arraySize);
+  double encodeTime = millisecondsSince(encodeStart);
+  auto decodeStart = std::chrono::high_resolution_clock::now();
+  std::string decoded = decodeMessage(digits, arraySize);
+  double decodeTime = millisecondsSince(decodeStart);
+
+  printf("%zu digits (%d characters) at p = %d: encode %.0f ms, decode %.0f ms\n",
+         digits.size(), length, kLargestPrime, encodeTime, decodeTime);
+  CHECK((int)digits.size() <= digitCount);
+  CHECK(decoded.compare(0, message.size(), message) == 0);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 random(15);
+  std::uniform_int_distribution<int> shortLength(1, 24), longLength(25, 300);
+
+  for (int p : kPrimes) {
+    int arraySize = p * p;
+    std::uniform_int_distribution<int> digit(0, arraySize - 1);
+
+    // the messages marked in practice, then longer ones and ones with NULs
+    // and high bits
+    for (int i = 0; i < 200; i++) {
+      checkMessage(randomMessage(random, shortLength(random), false), arraySize);
+    }
+    for (int i = 0; i < 10; i++) {
+      checkMessage(randomMessage(random, longLength(random), false), arraySize);
+    }
+    for (int i = 0; i < 100; i++) {
+      checkMessage(randomMessage(random, shortLength(random), true), arraySize);
+    }
+    const char* edges[] = {"a", "\x7f", "\x01", "\x40", "Hi there"};
+    for (const char* edge : edges) checkMessage(edge, arraySize);
+    checkMessage(std::string("\0\0a", 3), arraySize);
+    checkMessage(std::string("a\0\0", 3), arraySize);
+
+    // detection can read any digits, including a corrupt message
+    for (int i = 0; i < 100; i++) {
+      std::vector<int> digits(shortLength(random));
+      for (int& d : digits) d = digit(random);
+      checkDigits(digits, arraySize);
+    }
+    checkDigits(std::vector<int>(1, 0), arraySize);
+    checkDigits(std::vector<int>(3, arraySize - 1), arraySize);
+  }
+
+  // an empty message has no digits and no digits decode to nothing
+  CHECK(encodeMessage("", 49).empty());
+  CHECK(decodeMessage(std::vector<int>(), 49).empty());
+
+  // a framed message has at most p - 2 digits (its families stop below the
+  // header family)
+  checkLargePayload(random, kLargestPrime - 2);
+  checkLargePayload(random, (kLargestPrime - 2) / 2);
+  return testResult();
+}
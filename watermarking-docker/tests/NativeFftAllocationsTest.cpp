@@ -0,0 +1,90 @@
+// The native backend's scratch is kept per thread: after a first run of a
+// size, repeat transforms allocate nothing (nativeFftAllocations stays put).
+// Checked for forward, inverse and block transforms, strided regions, and
+// insertMark and extractMark, in both precisions, on one thread so the repeat
+// runs where the first did.
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/FftBackend.hpp"
+#include "watermarking-functions/LegendreArray.hpp"
+#include "watermarking-functions/NativeFft.hpp"
+#include "watermarking-functions/Utilities.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+
+namespace {
+
+struct Size2d {
+  int rows;
+  int cols;
+};
+
+// a Bluestein prime, odd and even composites, and an image shape
+const Size2d kSizes[] = {{37, 41}, {45, 75}, {64, 48}, {120, 160}};
+
+// run twice, the second run must allocate nothing
+void checkRepeat(const char* what, const Size2d& size, int depth,
+                 const std::function<void()>& run) {
+  run();
+  size_t before = nativeFftAllocations();
+  run();
+  size_t growth = nativeFftAllocations() - before;
+  if (growth != 0) {
+    printf("%s %dx%d %s: %zu allocations on the repeat run\n", what, size.rows, size.cols,
+           depth == CV_64F ? "double" : "float", growth);
+  }
+  CHECK(growth == 0);
+}
+
+template <typename T>
+void checkSize(const Size2d& size) {
+  int depth = cv::DataType<T>::depth;
+  cv::Mat input(size.rows, size.cols, depth);
+  cv::randu(input, -1.0, 1.0);
+  cv::Mat mat = input.clone();
+
+  checkRepeat("forward", size, depth, [&]() { realDft(mat, false); });
+  checkRepeat("inverse", size, depth, [&]() { realDft(mat, true); });
+
+  int p = largestPrimeFor(size.rows, size.cols);
+  cv::Mat block(p, p, depth);
+  checkRepeat("block", size, depth, [&]() { realDftBlock(mat, block); });
+
+  cv::Mat outer(size.rows + 3, size.cols + 5, depth);
+  cv::randu(outer, -1.0, 1.0);
+  cv::Mat region = outer(cv::Rect(2, 1, size.cols, size.rows));
+  checkRepeat("strided", size, depth, [&]() { realDft(region, false); });
+
+  std::vector<T> watermark(p * p), extracted(p * p);
+  LegendreArray(p, 1, 10.0).materialize(watermark.data());
+  checkRepeat("insertMark", size, depth, [&]() {
+    insertMark(LumaView<T>(mat), watermark.data(), p, p, 7);
+  });
+  checkRepeat("extractMark", size, depth, [&]() {
+    extractMark(LumaView<T>(mat), LumaView<T>(extracted.data(), p, p));
+  });
+}
+
+}  // namespace
+
+int main() {
+  cv::setNumThreads(1);
+  cv::setRNGSeed(25);
+  setFftBackend("native");
+  for (const Size2d& size : kSizes) {
+    checkSize<double>(size);
+    checkSize<float>(size);
+  }
+
+  // the counter does move when a new size needs scratch
+  size_t before = nativeFftAllocations();
+  cv::Mat larger(301, 401, CV_64F, cv::Scalar(0.5));
+  realDft(larger);
+  CHECK(nativeFftAllocations() > before);
+  return testResult();
+}
@@ -0,0 +1,204 @@
+// OriginalSidecar's write and open round trip, with and without the block,
+// the version 1 layout written before regions (read as marked over the whole
+// plane), and files open must refuse: missing, truncated, the wrong magic or
+// version, and regions outside the plane.
+
+#include <opencv2/opencv.hpp>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "watermarking-functions/LumaKernels.hpp"
+#include "watermarking-functions/OriginalSidecar.hpp"
+#include "watermarking-functions/Utilities.hpp"
+#include "watermarking-functions/WatermarkDetection.hpp"
+
+namespace {
+
+// the header mark-image wrote before regions were added
+struct Version1Header {
+  char magic[4];
+  uint32_t version;
+  int32_t rows;
+  int32_t cols;
+  int32_t p;
+  int32_t hasBlock;
+  uint64_t planeOffset;
+  uint64_t blockOffset;
+};
+
+cv::Mat randomPlane(int rows, int cols) {
+  cv::Mat plane(rows, cols, CV_8U);
+  cv::randu(plane, 0, 256);
+  return plane;
+}
+
+// extractMark's block for region of plane, as detection computes it
+std::vector<double> blockFor(const cv::Mat& plane, const cv::Rect& region, int p) {
+  cv::Mat luma(region.size(), CV_64F);
+  planeToLuma(plane(region), luma.ptr<double>(0));
+  std::vector<double> block(p * p);
+  extractMark(LumaView<double>(luma), LumaView<double>(block.data(), p, p));
+  return block;
+}
+
+bool samePlane(const cv::Mat& a, const cv::Mat& b) {
+  return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::string& contents) {
+  std::ofstream out(path.c_str(), std::ios::binary);
+  out.write(contents.data(), contents.size());
+}
+
+void checkRoundTrip(const std::string& path, bool withBlock) {
+  cv::Mat plane = randomPlane(90, 120);
+  cv::Rect region(10, 6, 100, 80);
+  int p = largestPrimeFor(region.height, region.width);
+  CHECK(OriginalSidecar::write(path, plane, region, p, withBlock));
+
+  OriginalSidecar sidecar;
+  CHECK(sidecar.open(path));
+  CHECK(sidecar.rows() == plane.rows && sidecar.cols() == plane.cols);
+  CHECK(sidecar.p() == p);
+  CHECK(sidecar.region() == region);
+  CHECK(samePlane(sidecar.valuePlane(), plane));
+  if (!withBlock) {
+    CHECK(sidecar.block() == nullptr);
+    return;
+  }
+
+  CHECK(sidecar.block() != nullptr);
+  if (sidecar.block() == nullptr) return;
+  std::vector<double> expected = blockFor(plane, region, p);
+  CHECK(memcmp(sidecar.block(), expected.data(), expected.size() * sizeof(double)) == 0);
+
+  // the mapping is copy on write, the file keeps the original plane
+  cv::Mat mapped = sidecar.valuePlane();
+  mapped.setTo(cv::Scalar(0));
+  OriginalSidecar reopened;
+  CHECK(reopened.open(path));
+  CHECK(samePlane(reopened.valuePlane(), plane));
+}
+
+// a version 1 sidecar is read as marked over the whole plane
+void checkVersion1(const std::string& path, bool withBlock) {
+  cv::Mat plane = randomPlane(61, 75);
+  int p = largestPrimeFor(plane.rows, plane.cols);
+  std::vector<double> block = blockFor(plane, cv::Rect(0, 0, plane.cols, plane.rows), p);
+
+  Version1Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "WMOS", 4);
+  header.version = 1;
+  header.rows = plane.rows;
+  header.cols = plane.cols;
+  header.p = p;
+  header.hasBlock = withBlock ? 1 : 0;
+  header.planeOffset = (sizeof(header) + 15) & ~size_t(15);
+  header.blockOffset = withBlock ? (header.planeOffset + plane.total() + 15) & ~uint64_t(15) : 0;
+
+  std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents.resize(header.planeOffset, '\0');
+  for (int y = 0; y < plane.rows; y++) {
+    contents.append(reinterpret_cast<const char*>(plane.ptr<uchar>(y)), plane.cols);
+  }
+  if (withBlock) {
+    contents.resize(header.blockOffset, '\0');
+    contents.append(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(double));
+  }
+  writeFile(path, contents);
+
+  OriginalSidecar sidecar;
+  CHECK(sidecar.open(path));
+  CHECK(sidecar.p() == p);
+  CHECK(sidecar.region() == cv::Rect(0, 0, plane.cols, plane.rows));
+  CHECK(samePlane(sidecar.valuePlane(), plane));
+  CHECK((sidecar.block() != nullptr) == withBlock);
+  if (withBlock && sidecar.block() != nullptr) {
+    CHECK(memcmp(sidecar.block(), block.data(), block.size() * sizeof(double)) == 0);
+  }
+}
+
+bool opens(const std::string& path) {
+  OriginalSidecar sidecar;
+  return sidecar.open(path);
+}
+
+void checkRejected(const std::string& path) {
+  cv::Mat plane = randomPlane(50, 60);
+  int p = largestPrimeFor(plane.rows, plane.cols);
+  cv::Rect whole(0, 0, plane.cols, plane.rows);
+  CHECK(!opens(path + ".missing"));
+
+  CHECK(OriginalSidecar::write(path, plane, whole, p, true));
+  std::string good = readFile(path);
+  CHECK(opens(path));
+
+  // truncated, in the header and in the block
+  writeFile(path, good.substr(0, 20));
+  CHECK(!opens(path));
+  writeFile(path, good.substr(0, good.size() - 1));
+  CHECK(!opens(path));
+  // trailing bytes
+  writeFile(path, good + "x");
+  CHECK(!opens(path));
+
+  std::string badMagic = good;
+  badMagic[0] = 'X';
+  writeFile(path, badMagic);
+  CHECK(!opens(path));
+
+  std::string badVersion = good;
+  uint32_t version = 3;
+  memcpy(&badVersion[4], &version, sizeof(version));
+  writeFile(path, badVersion);
+  CHECK(!opens(path));
+
+  // regions past the plane, and a p that doesn't fit the region
+  CHECK(OriginalSidecar::write(path, plane, cv::Rect(20, 0, 50, 50), 43, false));
+  CHECK(!opens(path));
+  CHECK(OriginalSidecar::write(path, plane, cv::Rect(0, 0, 30, 30), 29, false));
+  CHECK(!opens(path));
+  CHECK(OriginalSidecar::write(path, plane, cv::Rect(0, 0, 30, 30), 23, false));
+  CHECK(opens(path));
+
+  CHECK(isOriginalSidecar(path));
+  CHECK(!isOriginalSidecar("original.png"));
+  CHECK(!isOriginalSidecar(".wmo"));
+}
+
+}  // namespace
+
+int main() {
+  char directory[] = "/tmp/sidecar-test-XXXXXX";
+  if (mkdtemp(directory) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string path = std::string(directory) + "/original.png.wmo";
+
+  cv::setRNGSeed(17);
+  checkRoundTrip(path, false);
+  checkRoundTrip(path, true);
+  checkVersion1(path, false);
+  checkVersion1(path, true);
+  checkRejected(path);
+
+  unlink(path.c_str());
+  rmdir(directory);
+  return testResult();
+}
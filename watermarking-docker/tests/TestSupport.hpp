@@ -0,0 +1,52 @@
+/* Header for TestSupport */
+
+#ifndef TestSupport_hpp
+#define TestSupport_hpp
+
+#include <opencv2/opencv.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+// The checks the tests are written with. A failed check prints where it failed
+// and the test carries on; main returns testResult(), which run-tests.sh
+// reports.
+
+inline int& testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline void checkFailed(const char* file, int line, const char* what) {
+  fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+  testFailures()++;
+}
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) checkFailed(__FILE__, __LINE__, #condition);    \
+  } while (0)
+
+// the largest difference between two matrices of the same size and type,
+// relative to the largest magnitude in expected
+inline double relativeError(const cv::Mat& actual, const cv::Mat& expected) {
+  double scale = cv::norm(expected, cv::NORM_INF);
+  return cv::norm(actual, expected, cv::NORM_INF) / (scale > 0 ? scale : 1);
+}
+
+#define CHECK_CLOSE(actual, expected, tolerance)                                  \
+  do {                                                                            \
+    double error_ = relativeError(actual, expected);                              \
+    if (!(error_ <= (tolerance))) {                                               \
+      fprintf(stderr, "%s:%d: %s differs from %s by %g (relative)\n", __FILE__,  \
+              __LINE__, #actual, #expected, error_);                              \
+      testFailures()++;                                                           \
+    }                                                                             \
+  } while (0)
+
+inline int testResult() {
+  if (testFailures() > 0) fprintf(stderr, "%d checks failed\n", testFailures());
+  return testFailures() > 0 ? 1 : 0;
+}
+
+#endif /* TestSupport_hpp */
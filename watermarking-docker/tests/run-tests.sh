@@ -0,0 +1,43 @@
+#!/bin/bash
+# Build every tests/*Test.cpp against the watermarking library, the way the
+# Dockerfile builds mark-image and detect-wm, and run them (or only the tests
+# named as arguments, eg. FftBackendTest). Exits non-zero if any test fails.
+#   OPENCV_CFLAGS, OPENCV_LIBS  OpenCV's include and link flags (default: the
+#                               system's, as in the Dockerfile)
+#   BUILD_DIR                   where the library objects and tests are built
+set -e
+cd "$(dirname "$0")/.."
+
+OPENCV_CFLAGS=${OPENCV_CFLAGS:-"-I/usr/include -I/usr/include/opencv4"}
+OPENCV_LIBS=${OPENCV_LIBS:-"-L/usr/lib/x86_64-linux-gnu -lopencv_core -lopencv_imgcodecs \
+  -lopencv_imgproc"}
+BUILD_DIR=${BUILD_DIR:-/tmp/watermarking-tests}
+CXXFLAGS="-std=c++11 -O2 -I. -pthread"
+
+# the library is compiled once and linked into every test
+mkdir -p "$BUILD_DIR"
+objects=()
+for source in watermarking-functions/*.cpp; do
+  [ "$source" = watermarking-functions/ObjectDetection.cpp ] && continue
+  object="$BUILD_DIR/$(basename "$source" .cpp).o"
+  g++ $CXXFLAGS $OPENCV_CFLAGS -c "$source" -o "$object"
+  objects+=("$object")
+done
+
+tests=("$@")
+if [ ${#tests[@]} -eq 0 ]; then
+  for test in tests/*Test.cpp; do tests+=("$(basename "$test" .cpp)"); done
+fi
+
+failed=0
+for name in "${tests[@]}"; do
+  test="tests/$name.cpp"
+  g++ $CXXFLAGS $OPENCV_CFLAGS "$test" "${objects[@]}" $OPENCV_LIBS -o "$BUILD_DIR/$name"
+  if "$BUILD_DIR/$name"; then
+    echo "PASS $name"
+  else
+    echo "FAIL $name"
+    failed=1
+  fi
+done
+exit $failed
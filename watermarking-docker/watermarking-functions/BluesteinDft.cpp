@@ -0,0 +1,143 @@
+#include "BluesteinDft.hpp"
+
+#include <algorithm>
+#include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// below this length cv::dft is fast enough whatever the factors of the length
+const int minimumLength = 64;
+
+// rows transformed together, small enough that a block's buffer stays in cache
+const int blockRows = 16;
+
+bool lengthSuits(int n) {
+  return n >= minimumLength && cv::getOptimalDFTSize(n) != n;
+}
+
+// for transforms of length n: the chirp w[j] = exp(-i pi j^2 / n) (conjugated
+// for the inverse) and the spectrum of the convolution kernel conj(w), wrapped
+// to length m and scaled by 1 / m so the inverse transform needs no scaling
+template <typename T>
+struct ChirpPlan {
+  int n, m;
+  std::vector<std::complex<T> > chirp;
+  std::vector<std::complex<T> > kernelSpectrum;
+};
+
+// plans are built once per length and direction and shared by every call
+template <typename T>
+std::shared_ptr<const ChirpPlan<T> > planFor(int n, bool inverse) {
+  static std::map<std::pair<int, bool>, std::shared_ptr<const ChirpPlan<T> > > plans;
+  static std::mutex plansMutex;
+
+  std::lock_guard<std::mutex> lock(plansMutex);
+  auto found = plans.find(std::make_pair(n, inverse));
+  if (found != plans.end()) return found->second;
+
+  std::shared_ptr<ChirpPlan<T> > plan(new ChirpPlan<T>());
+  plan->n = n;
+  plan->m = cv::getOptimalDFTSize(2 * n - 1);
+
+  // the chirp and kernel are computed in double whatever T is, with j^2
+  // reduced mod 2n so the angle keeps its precision for large j
+  std::vector<std::complex<double> > chirp(n);
+  for (int j = 0; j < n; j++) {
+    double angle = CV_PI * (double)((long long)j * j % (2 * n)) / n;
+    chirp[j] = std::polar(1.0, inverse ? angle : -angle);
+  }
+
+  cv::Mat kernel = cv::Mat::zeros(1, plan->m, CV_64FC2);
+  std::complex<double>* k = kernel.ptr<std::complex<double> >(0);
+  k[0] = std::conj(chirp[0]);
+  for (int j = 1; j < n; j++) k[j] = k[plan->m - j] = std::conj(chirp[j]);
+  cv::dft(kernel, kernel, cv::DFT_SCALE);
+
+  plan->chirp.assign(chirp.begin(), chirp.end());
+  plan->kernelSpectrum.assign(k, k + plan->m);
+
+  plans[std::make_pair(n, inverse)] = plan;
+  return plan;
+}
+
+// transform every row of src (complex, any number of rows) into dst
+template <typename T>
+void transformRows(const cv::Mat& src, cv::Mat& dst, bool inverse) {
+  int n = src.cols;
+  if (!lengthSuits(n)) {
+    cv::dft(src, dst, cv::DFT_ROWS | (inverse ? cv::DFT_INVERSE : 0));
+    return;
+  }
+
+  std::shared_ptr<const ChirpPlan<T> > plan = planFor<T>(n, inverse);
+  const std::complex<T>* chirp = &plan->chirp[0];
+  const std::complex<T>* kernelSpectrum = &plan->kernelSpectrum[0];
+  int m = plan->m;
+
+  dst.create(src.rows, n, src.type());
+  int blocks = (src.rows + blockRows - 1) / blockRows;
+
+  // X[k] = w[k] * sum_j (x[j] w[j]) conj(w[k - j]), the sum being a circular
+  // convolution of length m computed with two smooth length transforms
+  cv::parallel_for_(cv::Range(0, blocks), [&](const cv::Range& range) {
+    cv::Mat work(blockRows, m, src.type());
+    for (int block = range.start; block < range.end; block++) {
+      int first = block * blockRows;
+      int count = std::min(blockRows, src.rows - first);
+      cv::Mat rows = work.rowRange(0, count);
+
+      for (int r = 0; r < count; r++) {
+        const std::complex<T>* in = src.ptr<std::complex<T> >(first + r);
+        std::complex<T>* w = rows.ptr<std::complex<T> >(r);
+        for (int j = 0; j < n; j++) w[j] = in[j] * chirp[j];
+        std::fill(w + n, w + m, std::complex<T>());
+      }
+
+      cv::dft(rows, rows, cv::DFT_ROWS);
+      for (int r = 0; r < count; r++) {
+        std::complex<T>* w = rows.ptr<std::complex<T> >(r);
+        for (int j = 0; j < m; j++) w[j] *= kernelSpectrum[j];
+      }
+      cv::dft(rows, rows, cv::DFT_ROWS | cv::DFT_INVERSE);
+
+      for (int r = 0; r < count; r++) {
+        const std::complex<T>* w = rows.ptr<std::complex<T> >(r);
+        std::complex<T>* out = dst.ptr<std::complex<T> >(first + r);
+        for (int j = 0; j < n; j++) out[j] = w[j] * chirp[j];
+      }
+    }
+  });
+}
+
+template <typename T>
+void transform2d(const cv::Mat& src, cv::Mat& dst, int flags) {
+  bool inverse = (flags & cv::DFT_INVERSE) != 0;
+
+  // rows, then columns as the rows of the transpose
+  cv::Mat rowsDone, columns;
+  transformRows<T>(src, rowsDone, inverse);
+  cv::transpose(rowsDone, columns);
+  transformRows<T>(columns, columns, inverse);
+  cv::transpose(columns, dst);
+
+  if (flags & cv::DFT_SCALE) dst.convertTo(dst, -1, 1.0 / ((double)src.rows * src.cols));
+}
+
+}  // namespace
+
+bool bluesteinSuits(int rows, int cols) {
+  return lengthSuits(rows) || lengthSuits(cols);
+}
+
+void bluesteinDft(const cv::Mat& src, cv::Mat& dst, int flags) {
+  CV_Assert(src.type() == CV_32FC2 || src.type() == CV_64FC2);
+
+  if (src.depth() == CV_32F)
+    transform2d<float>(src, dst, flags);
+  else
+    transform2d<double>(src, dst, flags);
+}
@@ -0,0 +1,23 @@
+/* Header for BluesteinDft */
+
+#ifndef BluesteinDft_hpp
+#define BluesteinDft_hpp
+
+#include <opencv2/opencv.hpp>
+
+// Discrete Fourier transforms of any length, including the prime lengths of the
+// watermark arrays, in O(n log n).
+// cv::dft falls back to an O(n^2) transform for large prime factors, so a p x p
+// transform costs O(p^3). Bluestein's algorithm rewrites each length n
+// transform as a circular convolution with a chirp, which is computed with
+// cv::dft at a smooth length m >= 2n - 1. The result is the exact length n
+// transform (not a padded one) so circular correlations are unchanged.
+
+// true when sides of these lengths are faster with bluesteinDft than cv::dft
+bool bluesteinSuits(int rows, int cols);
+
+// 2d transform of a complex (CV_32FC2 or CV_64FC2) matrix, with the same
+// results as cv::dft for flags of 0, DFT_INVERSE and DFT_INVERSE | DFT_SCALE
+void bluesteinDft(const cv::Mat& src, cv::Mat& dst, int flags = 0);
+
+#endif /* BluesteinDft_hpp */
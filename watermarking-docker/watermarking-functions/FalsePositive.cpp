@@ -0,0 +1,46 @@
+#include "FalsePositive.hpp"
+
+#include <cmath>
+
+namespace {
+
+// below this the probability of any of n shifts is n times that of one
+const double kUnionBound = 1e-8;
+
+// natural log of the upper tail probability of a standard normal at t, from
+// the asymptotic series once erfc underflows
+double logNormalTail(double t) {
+  double tail = 0.5 * std::erfc(t / std::sqrt(2.0));
+  if (tail > 1e-300) return std::log(tail);
+  return -0.5 * t * t - std::log(t * std::sqrt(2 * std::acos(-1.0)));
+}
+
+}  // namespace
+
+double log10FalsePositive(int p, double peak2rms) {
+  if (!(peak2rms > 0)) return 0.0;
+
+  // P(max of n > t) = 1 - (1 - tail)^n
+  double n = (double)p * p;
+  double logTail = logNormalTail(peak2rms);
+  double logProbability;
+  if (logTail + std::log(n) < std::log(kUnionBound))
+    logProbability = logTail + std::log(n);
+  else
+    logProbability = std::log(-std::expm1(n * std::log1p(-std::exp(logTail))));
+  return logProbability / std::log(10.0);
+}
+
+double thresholdForFalsePositive(int p, double rate) {
+  // the probability falls monotonically with the threshold, bisect for it
+  double target = std::log10(rate);
+  double low = 0.0, high = 64.0;
+  for (int i = 0; i < 60; i++) {
+    double middle = 0.5 * (low + high);
+    if (log10FalsePositive(p, middle) > target)
+      low = middle;
+    else
+      high = middle;
+  }
+  return high;
+}
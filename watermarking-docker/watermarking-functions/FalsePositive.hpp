@@ -0,0 +1,22 @@
+/* Header for FalsePositive */
+
+#ifndef FalsePositive_hpp
+#define FalsePositive_hpp
+
+// False positive probabilities for a family's correlation peak. In an unmarked
+// image each of the p^2 circular correlations of the extracted mark with a
+// +-1 Legendre array is a sum of p^2 terms of noise, close to normal, and the
+// arrays' flat autocorrelation keeps the shifts nearly independent, so the
+// peak-to-RMS of a family is the largest of p^2 standard normals and its
+// tail probability has a closed form. Probabilities are kept as log10, they
+// underflow a double for clearly marked families.
+
+// log10 of the probability that an unmarked family's peak-to-RMS reaches
+// peak2rms (0 for a peak at or below zero)
+double log10FalsePositive(int p, double peak2rms);
+
+// the peak-to-RMS at which an unmarked family's false positive probability
+// is rate (0 < rate < 1)
+double thresholdForFalsePositive(int p, double rate);
+
+#endif /* FalsePositive_hpp */
@@ -0,0 +1,232 @@
+#include "FftBackend.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+#include "NativeFft.hpp"
+#include "Utilities.hpp"
+
+void FftPlan::executeBlock(cv::Mat& mat, cv::Mat& block) const {
+  execute(mat);
+  mat(cv::Rect(1, 1, block.cols, block.rows)).copyTo(block);
+}
+
+namespace {
+
+class OpenCvPlan : public FftPlan {
+ public:
+  explicit OpenCvPlan(bool inverse) : inverse_(inverse) {}
+
+  void execute(cv::Mat& mat) const {
+    if (inverse_)
+      cv::dft(mat, mat, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+    else
+      cv::dft(mat, mat, cv::DFT_REAL_OUTPUT, mat.rows);
+  }
+
+ private:
+  bool inverse_;
+};
+
+class OpenCvBackend : public FftBackend {
+ public:
+  const char* name() const {
+    return "opencv";
+  }
+
+  std::shared_ptr<const FftPlan> plan(int, int, int, bool inverse) const {
+    return std::make_shared<OpenCvPlan>(inverse);
+  }
+};
+
+const FftBackend& openCvBackend() {
+  static OpenCvBackend backend;
+  return backend;
+}
+
+// the backend by name, nullptr for an unknown name
+const FftBackend* backendNamed(const std::string& name) {
+  if (name == "opencv") return &openCvBackend();
+  if (name == "native") return &nativeFftBackend();
+  return nullptr;
+}
+
+// (rows, cols, depth, inverse)
+typedef std::tuple<int, int, int, bool> PlanKey;
+
+// process-wide state, guarded by stateMutex (planning happens under the lock,
+// so threads asking for the same new transform measure it once)
+std::mutex stateMutex;
+std::string selectedBackend = "opencv";
+std::map<PlanKey, std::shared_ptr<const FftPlan> > plans;
+std::map<PlanKey, std::string> wisdom;
+std::string wisdomPath;
+
+std::string describe(const PlanKey& key) {
+  std::ostringstream line;
+  line << std::get<0>(key) << " " << std::get<1>(key) << " "
+       << (std::get<2>(key) == CV_32F ? "32F" : "64F") << " "
+       << (std::get<3>(key) ? "inverse" : "forward");
+  return line.str();
+}
+
+// runs of each plan timed, after one untimed run that sets up what a first
+// run pays for (the native plan's per-thread scratch, OpenCV's first use)
+const int kMeasureRuns = 3;
+
+// time plan on a matrix of random values (any real matrix is a valid CCS
+// packed spectrum, so the inverse is timed the same way), the fastest of
+// kMeasureRuns after a warm up run. Forward transforms are timed as mark
+// extraction runs them, through executeBlock for the p x p block of the
+// largest prime that fits, which backends may prune to.
+double measure(const FftPlan& plan, const PlanKey& key) {
+  int rows = std::get<0>(key), cols = std::get<1>(key), depth = std::get<2>(key);
+  bool inverse = std::get<3>(key);
+  cv::Mat input(rows, cols, depth);
+  cv::randu(input, -1.0, 1.0);
+  cv::Mat block;
+  if (!inverse && std::min(rows, cols) >= 4) {  // at least a 2 x 2 block fits
+    int p = largestPrimeFor(rows, cols);
+    block.create(p, p, depth);
+  }
+
+  auto run = [&]() {
+    cv::Mat mat = input.clone();  // the transforms are in place
+    if (block.empty())
+      plan.execute(mat);
+    else
+      plan.executeBlock(mat, block);
+  };
+  run();
+
+  double best = 1e30;
+  for (int r = 0; r < kMeasureRuns; r++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    run();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+// add the wisdom in the file at path to entries, keeping the entries already
+// there (a missing file adds nothing, false if it can't be parsed)
+bool readWisdom(const std::string& path, std::map<PlanKey, std::string>& entries) {
+  std::ifstream file(path.c_str());
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) continue;
+    std::istringstream fields(line);
+    int rows, cols;
+    std::string depth, direction, backend;
+    if (!(fields >> rows >> cols >> depth >> direction >> backend) ||
+        (depth != "32F" && depth != "64F") ||
+        (direction != "forward" && direction != "inverse")) {
+      return false;
+    }
+    PlanKey key(rows, cols, depth == "32F" ? CV_32F : CV_64F, direction == "inverse");
+    entries.insert(std::make_pair(key, backend));
+  }
+  return true;
+}
+
+// merge the wisdom with the file's (other processes sharing it may have added
+// to it since it was loaded), write it to a temporary file of this process's
+// own and rename that over the file, so a concurrent reader never sees a
+// partial file. A lock file keeps writers from dropping each other's entries.
+void saveWisdom() {
+  int lock = open((wisdomPath + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+  if (lock >= 0) flock(lock, LOCK_EX);
+
+  readWisdom(wisdomPath, wisdom);
+
+  std::ostringstream temporary;
+  temporary << wisdomPath << ".tmp" << getpid();
+  bool written;
+  {
+    std::ofstream file(temporary.str().c_str());
+    for (auto it = wisdom.begin(); it != wisdom.end(); ++it)
+      file << describe(it->first) << " " << it->second << "\n";
+    written = static_cast<bool>(file);
+  }
+  if (!written || std::rename(temporary.str().c_str(), wisdomPath.c_str()) != 0)
+    std::remove(temporary.str().c_str());
+
+  if (lock >= 0) close(lock);  // releases the lock
+}
+
+// plan the transform for key with the selected backend, in auto with the one
+// wisdom names, measuring both (and recording the faster) when it names none
+std::shared_ptr<const FftPlan> planFor(const PlanKey& key) {
+  int rows = std::get<0>(key), cols = std::get<1>(key), depth = std::get<2>(key);
+  bool inverse = std::get<3>(key);
+
+  if (selectedBackend != "auto")
+    return backendNamed(selectedBackend)->plan(rows, cols, depth, inverse);
+
+  auto known = wisdom.find(key);
+  if (known != wisdom.end() && backendNamed(known->second) != nullptr)
+    return backendNamed(known->second)->plan(rows, cols, depth, inverse);
+
+  const FftBackend* candidates[] = {&openCvBackend(), &nativeFftBackend()};
+  std::shared_ptr<const FftPlan> best;
+  double bestTime = 0;
+  for (const FftBackend* backend : candidates) {
+    std::shared_ptr<const FftPlan> plan = backend->plan(rows, cols, depth, inverse);
+    double time = measure(*plan, key);
+    if (!best || time < bestTime) {
+      best = plan;
+      bestTime = time;
+      wisdom[key] = backend->name();
+    }
+  }
+  if (!wisdomPath.empty()) saveWisdom();
+  return best;
+}
+
+}  // namespace
+
+bool setFftBackend(const std::string& name) {
+  if (name != "auto" && backendNamed(name) == nullptr) return false;
+
+  std::lock_guard<std::mutex> lock(stateMutex);
+  if (name != selectedBackend) plans.clear();
+  selectedBackend = name;
+  return true;
+}
+
+std::shared_ptr<const FftPlan> fftPlan(int rows, int cols, int depth, bool inverse) {
+  PlanKey key(rows, cols, depth, inverse);
+
+  std::lock_guard<std::mutex> lock(stateMutex);
+  auto found = plans.find(key);
+  if (found != plans.end()) return found->second;
+
+  std::shared_ptr<const FftPlan> plan = planFor(key);
+  plans[key] = plan;
+  return plan;
+}
+
+void realDft(cv::Mat& mat, bool inverse) {
+  fftPlan(mat.rows, mat.cols, mat.depth(), inverse)->execute(mat);
+}
+
+void realDftBlock(cv::Mat& mat, cv::Mat& block) {
+  fftPlan(mat.rows, mat.cols, mat.depth(), false)->executeBlock(mat, block);
+}
+
+bool useFftWisdom(const std::string& path) {
+  std::lock_guard<std::mutex> lock(stateMutex);
+  wisdomPath = path;
+  return readWisdom(path, wisdom);
+}
@@ -0,0 +1,69 @@
+/* Header for FftBackend */
+
+#ifndef FftBackend_hpp
+#define FftBackend_hpp
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// The image sized real transforms (insertMark, extractMark and
+// WatermarkPattern) run through a backend chosen at runtime:
+// - "opencv" (the default): cv::dft
+// - "native": the transform in NativeFft
+// - "auto": whichever of the two ran faster for that size, depth and direction
+//   when it was first planned, or as recorded in a wisdom file
+// Every backend reads and writes OpenCV's CCS packed spectrum, so the
+// watermark block is at (1..p, 1..p) whichever one runs. Plans are cached for
+// the life of the process, keyed by (rows, cols, depth, direction).
+
+// a transform of one size, depth and direction, shared between threads
+class FftPlan {
+ public:
+  virtual ~FftPlan() {}
+
+  // transform mat (the plan's size and depth, single channel, and possibly a
+  // strided region of a larger matrix) in place, a real matrix to its CCS
+  // packed spectrum, or (inverse) a CCS packed spectrum back to the real
+  // matrix scaled by 1 / (rows cols)
+  virtual void execute(cv::Mat& mat) const = 0;
+
+  // for a forward plan, the (block.rows x block.cols) block of mat's spectrum
+  // at (1, 1) written into block (the plan's depth), leaving mat unspecified.
+  // The default transforms mat in place and copies the block out, plans that
+  // can compute only the block's coefficients override it.
+  virtual void executeBlock(cv::Mat& mat, cv::Mat& block) const;
+};
+
+class FftBackend {
+ public:
+  virtual ~FftBackend() {}
+  virtual const char* name() const = 0;
+
+  // depth is CV_32F or CV_64F
+  virtual std::shared_ptr<const FftPlan> plan(int rows, int cols, int depth,
+                                              bool inverse) const = 0;
+};
+
+// "opencv", "native" or "auto" for the plans made from now on, false for any
+// other name (the plan cache is cleared when the backend changes)
+bool setFftBackend(const std::string& name);
+
+// the cached plan for a transform, planned (and in auto, measured) on first use
+std::shared_ptr<const FftPlan> fftPlan(int rows, int cols, int depth, bool inverse);
+
+// plan (or find the plan) and execute it on mat
+void realDft(cv::Mat& mat, bool inverse = false);
+
+// plan (or find the plan) and execute its executeBlock
+void realDftBlock(cv::Mat& mat, cv::Mat& block);
+
+// Wisdom records the backend auto chose for each transform, one line of
+// "rows cols depth forward|inverse backend" per plan, so a fresh process runs
+// tuned plans from its first transform. Load the file at path (a missing file
+// is empty wisdom, false if it can't be parsed) and rewrite it whenever auto
+// measures a transform it didn't have, keeping what other processes sharing
+// the file have added (under <path>.lock).
+bool useFftWisdom(const std::string& path);
+
+#endif /* FftBackend_hpp */
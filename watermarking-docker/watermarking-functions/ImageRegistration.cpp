@@ -0,0 +1,208 @@
+#include "ImageRegistration.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// rotation and scale are estimated on the first pyramid level this small
+const int kCoarseSize = 256;
+
+// rows of the log-polar spectra, each a step of 360 / kAngleSteps degrees (more
+// steps oversample the coarse level near its centre)
+const int kAngleSteps = 360;
+
+// times the rotation and scale are re-estimated on the residual
+const int kRotationRounds = 3;
+
+// weakest translation peak a warp is trusted on
+const double kMinResponse = 0.05;
+
+// smaller corrections than these are left alone
+const double kMinAngle = 0.01;   // degrees
+const double kMinScale = 1e-4;   // relative
+const double kMinShift = 0.05;   // pixels
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// level 0 is the plane, each level after is pyrDown of the one before, so a
+// point x on a level is 2x on the level before it
+std::vector<cv::Mat> buildPyramid(const cv::Mat& plane) {
+  std::vector<cv::Mat> levels(1, plane);
+  while (std::max(levels.back().rows, levels.back().cols) > kCoarseSize) {
+    cv::Mat next;
+    cv::pyrDown(levels.back(), next);
+    levels.push_back(next);
+  }
+  return levels;
+}
+
+// the magnitude spectrum of level, centred and high-passed so the low
+// frequency peak doesn't swamp the image's structure, in log-polar
+// coordinates (rows are angle over 360 degrees, cols are log radius)
+cv::Mat logPolarSpectrum(const cv::Mat& level, const cv::Mat& window, cv::Size size) {
+  cv::Mat windowed, spectrum, magnitude;
+  level.convertTo(windowed, CV_32F);
+  cv::multiply(windowed, window, windowed);
+  cv::dft(windowed, spectrum, cv::DFT_COMPLEX_OUTPUT);
+  cv::Mat planes[2];
+  cv::split(spectrum, planes);
+  cv::magnitude(planes[0], planes[1], magnitude);
+
+  int rows = magnitude.rows, cols = magnitude.cols;
+  cv::Mat centred(rows, cols, CV_32F);
+  for (int y = 0; y < rows; y++) {
+    const float* source = magnitude.ptr<float>((y - rows / 2 + rows) % rows);
+    float* row = centred.ptr<float>(y);
+    double eta = std::cos(CV_PI * (y - rows / 2) / rows);
+    for (int x = 0; x < cols; x++) {
+      double highPass = eta * std::cos(CV_PI * (x - cols / 2) / cols);
+      row[x] = (float)(source[(x - cols / 2 + cols) % cols] * (1 - highPass) * (2 - highPass));
+    }
+  }
+
+  cv::Mat logPolar;
+  double maxRadius = std::min(rows, cols) / 2.0;
+  cv::warpPolar(centred, logPolar, size, cv::Point2f(cols / 2, rows / 2),
+                maxRadius, cv::INTER_LINEAR | cv::WARP_POLAR_LOG);
+  return logPolar;
+}
+
+// the rotation (degrees) and scale taking reference to plane
+void estimateRotationScale(const cv::Mat& reference, const cv::Mat& plane, double& angle,
+                           double& scale) {
+  cv::Size size(std::max(reference.rows, reference.cols), kAngleSteps);
+  double maxRadius = std::min(reference.rows, reference.cols) / 2.0;
+  cv::Point2f centre(reference.cols / 2.0f, reference.rows / 2.0f);
+  cv::Mat window;
+  cv::createHanningWindow(window, reference.size(), CV_32F);
+  cv::Mat referenceSpectrum = logPolarSpectrum(reference, window, size);
+
+  // rotating an image rotates its spectrum the same way, scaling it by s
+  // scales the spectrum by 1 / s, and both are shifts in log-polar
+  // coordinates. The spectra share the pixel grid's own structure, which
+  // pulls each estimate towards no rotation, so the residual left after
+  // undoing the estimate is measured again a few times.
+  angle = 0.0;
+  scale = 1.0;
+  cv::Mat unrotated = plane;
+  for (int round = 0; round < kRotationRounds; round++) {
+    cv::Point2d shift =
+        cv::phaseCorrelate(referenceSpectrum, logPolarSpectrum(unrotated, window, size));
+
+    // the magnitude spectrum is symmetric, so the angle is only known mod 180
+    double residual = -shift.y * 360.0 / size.height;
+    while (residual > 90) residual -= 180;
+    while (residual <= -90) residual += 180;
+    angle += residual;
+    scale *= std::exp(-shift.x * std::log(maxRadius) / size.width);
+
+    cv::warpAffine(plane, unrotated, cv::getRotationMatrix2D(centre, angle, scale),
+                   plane.size(), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REFLECT);
+  }
+}
+
+// refine the translation of transform (plane = reference warped by transform)
+// by phase correlating the reference with the plane mapped back through it,
+// returning the correlation peak
+double refineTranslation(const cv::Mat& reference, const cv::Mat& plane, cv::Mat& transform) {
+  cv::Mat unwarped, reference32, unwarped32, window;
+  cv::warpAffine(plane, unwarped, transform, plane.size(), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                 cv::BORDER_REFLECT);
+  reference.convertTo(reference32, CV_32F);
+  unwarped.convertTo(unwarped32, CV_32F);
+  cv::createHanningWindow(window, reference.size(), CV_32F);
+
+  double response = 0;
+  cv::Point2d d = cv::phaseCorrelate(reference32, unwarped32, window, &response);
+
+  // unwarped(x) = reference(x - d), so the plane's translation moves by A d
+  double* t0 = transform.ptr<double>(0);
+  double* t1 = transform.ptr<double>(1);
+  t0[2] += t0[0] * d.x + t0[1] * d.y;
+  t1[2] += t1[0] * d.x + t1[1] * d.y;
+  return response;
+}
+
+// refine transform (for the coarsest level) from the coarsest level down to
+// finest, scaling its translation to level 0, returning the last peak
+double refineLevels(const std::vector<cv::Mat>& referenceLevels,
+                    const std::vector<cv::Mat>& planeLevels, int finest, cv::Mat& transform) {
+  double response = 0;
+  for (int level = (int)referenceLevels.size() - 1; level >= finest; level--) {
+    if (level < (int)referenceLevels.size() - 1) {
+      transform.at<double>(0, 2) *= 2;
+      transform.at<double>(1, 2) *= 2;
+    }
+    response = refineTranslation(referenceLevels[level], planeLevels[level], transform);
+  }
+  transform.at<double>(0, 2) *= 1 << finest;
+  transform.at<double>(1, 2) *= 1 << finest;
+  return response;
+}
+
+}  // namespace
+
+void registerPlane(const cv::Mat& reference, cv::Mat& plane, RegistrationStats& stats) {
+  stats.applied = false;
+  stats.angle = 0.0;
+  stats.scale = 1.0;
+  stats.shiftX = 0.0;
+  stats.shiftY = 0.0;
+  stats.response = 0.0;
+  stats.timePyramid = stats.timeRotationScale = stats.timeTranslation = stats.timeWarp = 0.0;
+  if (std::min(reference.rows, reference.cols) < 16) return;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<cv::Mat> referenceLevels = buildPyramid(reference);
+  std::vector<cv::Mat> planeLevels = buildPyramid(plane);
+  int coarsest = (int)referenceLevels.size() - 1;
+  stats.timePyramid = millisecondsSince(start);
+
+  start = std::chrono::high_resolution_clock::now();
+  estimateRotationScale(referenceLevels[coarsest], planeLevels[coarsest], stats.angle,
+                        stats.scale);
+  const cv::Mat& coarse = referenceLevels[coarsest];
+  cv::Mat transform = cv::getRotationMatrix2D(cv::Point2f(coarse.cols / 2.0f, coarse.rows / 2.0f),
+                                              stats.angle, stats.scale);
+  stats.timeRotationScale = millisecondsSince(start);
+
+  // refine down to half resolution (full resolution when there's one level),
+  // the full plane is only warped once at the end. A small rotation or scale
+  // estimate can be noise, so a translation-only fit is tried too and the
+  // better matching of the two is kept.
+  start = std::chrono::high_resolution_clock::now();
+  int finest = coarsest > 0 ? 1 : 0;
+  stats.response = refineLevels(referenceLevels, planeLevels, finest, transform);
+  cv::Mat translation = cv::Mat::eye(2, 3, CV_64F);
+  double translationResponse = refineLevels(referenceLevels, planeLevels, finest, translation);
+  if (translationResponse >= stats.response) {
+    transform = translation;
+    stats.response = translationResponse;
+    stats.angle = 0.0;
+    stats.scale = 1.0;
+  }
+  stats.timeTranslation = millisecondsSince(start);
+
+  // report the translation left once rotating and scaling about the centre
+  cv::Mat centred = cv::getRotationMatrix2D(
+      cv::Point2f(reference.cols / 2.0f, reference.rows / 2.0f), stats.angle, stats.scale);
+  stats.shiftX = transform.at<double>(0, 2) - centred.at<double>(0, 2);
+  stats.shiftY = transform.at<double>(1, 2) - centred.at<double>(1, 2);
+
+  bool identity = std::fabs(stats.angle) < kMinAngle && std::fabs(stats.scale - 1) < kMinScale &&
+                  std::fabs(stats.shiftX) < kMinShift && std::fabs(stats.shiftY) < kMinShift;
+  if (identity || stats.response < kMinResponse) return;
+
+  start = std::chrono::high_resolution_clock::now();
+  cv::Mat aligned = reference.clone();
+  cv::warpAffine(plane, aligned, transform, reference.size(),
+                 cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_TRANSPARENT);
+  plane = aligned;
+  stats.applied = true;
+  stats.timeWarp = millisecondsSince(start);
+}
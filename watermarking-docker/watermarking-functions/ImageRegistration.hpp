@@ -0,0 +1,24 @@
+/* Header for ImageRegistration */
+
+#ifndef ImageRegistration_hpp
+#define ImageRegistration_hpp
+
+#include <opencv2/opencv.hpp>
+
+#include "Utilities.hpp"
+
+// Align a capture's value plane to the original's before they are subtracted,
+// for captures that were resized, shifted, rotated or scaled on the way back.
+// - rotation and scale come from phase correlating the log-polar magnitude
+//   spectra of the coarsest pyramid level (magnitude spectra ignore
+//   translation)
+// - translation is found at the coarsest level and refined one pyramid level
+//   at a time, each level mapped back through the estimate so far, and a
+//   translation-only fit replaces the estimate when it matches better
+// - the full resolution plane is warped once, pixels with no capture data
+//   take the reference's value so they subtract to zero
+// The plane is left as it is when the estimate is the identity or the match
+// is too weak to trust. Both planes are CV_8U and the same size.
+void registerPlane(const cv::Mat& reference, cv::Mat& plane, RegistrationStats& stats);
+
+#endif /* ImageRegistration_hpp */
@@ -0,0 +1,25 @@
+#include "LegendreArray.hpp"
+
+LegendreArray::LegendreArray(int p, int k, double strength, int messageNum)
+    : p_(p),
+      vShift_((messageNum / p) % p),
+      hShift_(messageNum % p),
+      values_(p, -strength),
+      columnShifts_(p) {
+  // set the values where the index is a square (mod p) to 1 (times strength),
+  // the products are taken in 64 bits so large p and k can't overflow
+  for (int i = 0; i < p; i++) {
+    long long square = (long long)i * i % p;
+    values_[square] = strength;
+    columnShifts_[i] = (int)(square * (k % p) % p);
+  }
+}
+
+template <typename T>
+void LegendreArray::materialize(T* array) const {
+  for (int row = 0; row < p_; row++)
+    for (int col = 0; col < p_; col++) array[row * p_ + col] = (T)(*this)(row, col);
+}
+
+template void LegendreArray::materialize<float>(float*) const;
+template void LegendreArray::materialize<double>(double*) const;
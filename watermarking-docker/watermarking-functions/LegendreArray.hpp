@@ -0,0 +1,44 @@
+/* Header for LegendreArray */
+
+#ifndef LegendreArray_hpp
+#define LegendreArray_hpp
+
+#include <vector>
+
+// A watermark array from family k, read element by element without storing
+// the p x p array.
+// Element (row, col) is the same as generateArray(p, k) multiplied by strength
+// and then moved by shiftIntoNewArray(messageNum), but only the p-length
+// Legendre sequence and the p column shifts are kept. Use materialize when a
+// transform needs the whole array.
+class LegendreArray {
+ public:
+  LegendreArray(int p, int k, double strength = 1.0, int messageNum = 0);
+
+  int size() const {
+    return p_;
+  }
+
+  double operator()(int row, int col) const {
+    // undo the message shift, then read the column's shifted sequence
+    int j = row - vShift_;
+    int i = col - hShift_;
+    if (j < 0) j += p_;
+    if (i < 0) i += p_;
+    int x = j + columnShifts_[i];
+    return values_[x < p_ ? x : x - p_];
+  }
+
+  // write the whole array, in row major order
+  template <typename T>
+  void materialize(T* array) const;
+
+ private:
+  int p_;
+  int vShift_;
+  int hShift_;
+  std::vector<double> values_;     // strength * Legendre sequence (L[0] = 1)
+  std::vector<int> columnShifts_;  // i^2 k mod p
+};
+
+#endif /* LegendreArray_hpp */
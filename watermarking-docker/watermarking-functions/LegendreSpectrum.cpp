@@ -0,0 +1,78 @@
+#include "LegendreSpectrum.hpp"
+
+#include <cmath>
+
+namespace {
+
+int powMod(long long base, int exponent, int p) {
+  long long result = 1;
+  base %= p;
+  while (exponent > 0) {
+    if (exponent & 1) result = result * base % p;
+    base = base * base % p;
+    exponent >>= 1;
+  }
+  return (int)result;
+}
+
+}  // namespace
+
+LegendreSpectrum::LegendreSpectrum(int p)
+    : p_(p),
+      chi_(p, -1),
+      squares_(p),
+      inverseOf4_(p, 0),
+      roots_(p),
+      lambda_(p) {
+  CV_Assert(p > 2);
+
+  chi_[0] = 0;
+  for (int x = 0; x < p; x++) {
+    squares_[x] = (int)((long long)x * x % p);
+    if (x != 0) chi_[squares_[x]] = 1;
+  }
+
+  // Fermat's little theorem, 1 / y = y^(p - 2)
+  for (int x = 1; x < p; x++) inverseOf4_[x] = powMod(4LL * x, p - 2, p);
+
+  for (int x = 0; x < p; x++) roots_[x] = std::polar(1.0, -2.0 * CV_PI * x / p);
+
+  double rootP = std::sqrt((double)p);
+  gauss_ = (p % 4 == 1) ? std::complex<double>(rootP, 0.0) : std::complex<double>(0.0, rootP);
+
+  // L[0] = 1 (0 is a square) where chi(0) = 0, which adds 1 to every term
+  lambda_[0] = 1.0;
+  for (int u = 1; u < p; u++) lambda_[u] = 1.0 + (double)chi_[p - u] * gauss_;
+}
+
+void LegendreSpectrum::spectrumFor(int k, cv::Mat& spectrum, int depth) const {
+  CV_Assert(depth == CV_32F || depth == CV_64F);
+  int p = p_;
+  long long family = ((long long)k % p + p) % p;
+
+  spectrum.create(p, p, CV_MAKETYPE(depth, 2));
+
+  cv::parallel_for_(cv::Range(0, p), [&](const cv::Range& rows) {
+    std::vector<std::complex<double> > row(p);
+    for (int u = rows.start; u < rows.end; u++) {
+      int a = (int)(u * family % p);
+
+      if (a == 0) {
+        // every column has the same shift, only v = 0 survives the sum
+        std::fill(row.begin(), row.end(), std::complex<double>());
+        row[0] = lambda_[u] * (double)p;
+      } else {
+        std::complex<double> scale = lambda_[u] * (double)chi_[a] * gauss_;
+        long long inverse = inverseOf4_[a];
+        for (int v = 0; v < p; v++) row[v] = scale * roots_[squares_[v] * inverse % p];
+      }
+
+      if (depth == CV_64F) {
+        std::copy(row.begin(), row.end(), spectrum.ptr<std::complex<double> >(u));
+      } else {
+        std::complex<float>* out = spectrum.ptr<std::complex<float> >(u);
+        for (int v = 0; v < p; v++) out[v] = std::complex<float>(row[v]);
+      }
+    }
+  });
+}
@@ -0,0 +1,39 @@
+/* Header for LegendreSpectrum */
+
+#ifndef LegendreSpectrum_hpp
+#define LegendreSpectrum_hpp
+
+#include <complex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// The 2d DFT of the watermark arrays made by generateArray, written directly
+// in O(p^2) instead of transforming the array.
+// Column i of family k is the Legendre sequence L shifted by s = i^2 k (mod p),
+// so with Lambda(u) the DFT of L and Q(a, b) = sum_i exp(2 pi i (a i^2 - b i) / p)
+//   F[u][v] = Lambda(u) Q(uk, v)
+// Both are closed form in terms of the Gauss sum g = sum_x chi(x) exp(2 pi i x / p)
+// (sqrt(p) when p = 1 mod 4, i sqrt(p) when p = 3 mod 4):
+//   Lambda(0) = 1, Lambda(u) = 1 + chi(-u) g
+//   Q(a, b) = chi(a) g exp(-2 pi i b^2 / (4a) / p), and Q(0, b) = p if b = 0, else 0
+class LegendreSpectrum {
+ public:
+  // p is an odd prime
+  explicit LegendreSpectrum(int p);
+
+  // the full complex spectrum (p x p, CV_32FC2 or CV_64FC2 as depth is CV_32F
+  // or CV_64F) of generateArray(p, k), the same as cv::dft with
+  // DFT_COMPLEX_OUTPUT up to rounding
+  void spectrumFor(int k, cv::Mat& spectrum, int depth = CV_64F) const;
+
+ private:
+  int p_;
+  std::vector<int> chi_;                      // Legendre symbol of x, chi(0) = 0
+  std::vector<int> squares_;                  // x^2 mod p
+  std::vector<int> inverseOf4_;               // 1 / (4x) mod p, x != 0
+  std::vector<std::complex<double> > roots_;  // exp(-2 pi i x / p)
+  std::vector<std::complex<double> > lambda_;
+  std::complex<double> gauss_;
+};
+
+#endif /* LegendreSpectrum_hpp */
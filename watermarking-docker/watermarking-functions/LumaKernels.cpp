@@ -0,0 +1,387 @@
+#include "LumaKernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define LUMA_KERNELS_X86 1
+#endif
+
+namespace {
+
+// scalar versions, these define the results the vector versions must match
+
+template <typename T>
+void planeRowToLuma(const uchar* plane, T* luma, int cols) {
+  for (int x = 0; x < cols; x++) luma[x] = plane[x] / T(255.0);
+}
+
+template <typename T>
+void differenceRowToLuma(const uchar* marked, const uchar* original, T* luma, int cols) {
+  for (int x = 0; x < cols; x++) luma[x] = (marked[x] - original[x]) / T(255.0);
+}
+
+template <typename T>
+void lumaRowToPlane(const T* luma, uchar* plane, int cols) {
+  for (int x = 0; x < cols; x++) {
+    float lumaValue = luma[x] * 255.0;
+
+    if (lumaValue > 255.0)
+      plane[x] = 255;
+    else if (lumaValue < 0.0)
+      plane[x] = 0;
+    else
+      plane[x] = (uchar)(int)round(lumaValue);
+  }
+}
+
+#ifdef LUMA_KERNELS_X86
+
+// round half away from zero for values already clamped to [0, 255]
+// (x + 0.5 then truncating can round up values just below a half)
+__attribute__((target("avx2"))) inline __m256 roundClamped8(__m256 x) {
+  __m256 whole = _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  __m256 up = _mm256_cmp_ps(_mm256_sub_ps(x, whole), _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+  return _mm256_add_ps(whole, _mm256_and_ps(up, _mm256_set1_ps(1.0f)));
+}
+
+__attribute__((target("sse4.1"))) inline __m128 roundClamped4(__m128 x) {
+  __m128 whole = _mm_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  __m128 up = _mm_cmpge_ps(_mm_sub_ps(x, whole), _mm_set1_ps(0.5f));
+  return _mm_add_ps(whole, _mm_and_ps(up, _mm_set1_ps(1.0f)));
+}
+
+__attribute__((target("avx2"))) void planeRowToLumaAVX2(const uchar* plane, double* luma,
+                                                          int cols) {
+  const __m256d scale = _mm256_set1_pd(255.0);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(plane + x)));
+    __m256d low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(values));
+    __m256d high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(values, 1));
+    _mm256_storeu_pd(luma + x, _mm256_div_pd(low, scale));
+    _mm256_storeu_pd(luma + x + 4, _mm256_div_pd(high, scale));
+  }
+  planeRowToLuma(plane + x, luma + x, cols - x);
+}
+
+__attribute__((target("avx2"))) void planeRowToLumaAVX2(const uchar* plane, float* luma,
+                                                          int cols) {
+  const __m256 scale = _mm256_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(plane + x)));
+    _mm256_storeu_ps(luma + x, _mm256_div_ps(_mm256_cvtepi32_ps(values), scale));
+  }
+  planeRowToLuma(plane + x, luma + x, cols - x);
+}
+
+__attribute__((target("avx2"))) void differenceRowToLumaAVX2(const uchar* marked,
+                                                               const uchar* original,
+                                                               double* luma, int cols) {
+  const __m256d scale = _mm256_set1_pd(255.0);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(marked + x)));
+    __m256i o = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(original + x)));
+    __m256i difference = _mm256_sub_epi32(m, o);
+    __m256d low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(difference));
+    __m256d high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(difference, 1));
+    _mm256_storeu_pd(luma + x, _mm256_div_pd(low, scale));
+    _mm256_storeu_pd(luma + x + 4, _mm256_div_pd(high, scale));
+  }
+  differenceRowToLuma(marked + x, original + x, luma + x, cols - x);
+}
+
+__attribute__((target("avx2"))) void differenceRowToLumaAVX2(const uchar* marked,
+                                                               const uchar* original,
+                                                               float* luma, int cols) {
+  const __m256 scale = _mm256_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(marked + x)));
+    __m256i o = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(original + x)));
+    __m256 difference = _mm256_cvtepi32_ps(_mm256_sub_epi32(m, o));
+    _mm256_storeu_ps(luma + x, _mm256_div_ps(difference, scale));
+  }
+  differenceRowToLuma(marked + x, original + x, luma + x, cols - x);
+}
+
+__attribute__((target("avx2"))) void lumaRowToPlaneAVX2(const double* luma, uchar* plane,
+                                                          int cols) {
+  const __m256d scale = _mm256_set1_pd(255.0);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m128 low = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(luma + x), scale));
+    __m128 high = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(luma + x + 4), scale));
+    __m256 values = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+    values = _mm256_min_ps(_mm256_max_ps(values, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    __m256i rounded = _mm256_cvttps_epi32(roundClamped8(values));
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                                     _mm256_extracti128_si256(rounded, 1));
+    _mm_storel_epi64((__m128i*)(plane + x), _mm_packus_epi16(words, words));
+  }
+  lumaRowToPlane(luma + x, plane + x, cols - x);
+}
+
+__attribute__((target("avx2"))) void lumaRowToPlaneAVX2(const float* luma, uchar* plane,
+                                                          int cols) {
+  const __m256 scale = _mm256_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 8 <= cols; x += 8) {
+    __m256 values = _mm256_mul_ps(_mm256_loadu_ps(luma + x), scale);
+    values = _mm256_min_ps(_mm256_max_ps(values, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    __m256i rounded = _mm256_cvttps_epi32(roundClamped8(values));
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                                     _mm256_extracti128_si256(rounded, 1));
+    _mm_storel_epi64((__m128i*)(plane + x), _mm_packus_epi16(words, words));
+  }
+  lumaRowToPlane(luma + x, plane + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void planeRowToLumaSSE41(const uchar* plane, double* luma,
+                                                             int cols) {
+  const __m128d scale = _mm_set1_pd(255.0);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    int packed;
+    memcpy(&packed, plane + x, sizeof(packed));
+    __m128i values = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+    _mm_storeu_pd(luma + x, _mm_div_pd(_mm_cvtepi32_pd(values), scale));
+    _mm_storeu_pd(luma + x + 2, _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(values, 8)), scale));
+  }
+  planeRowToLuma(plane + x, luma + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void planeRowToLumaSSE41(const uchar* plane, float* luma,
+                                                             int cols) {
+  const __m128 scale = _mm_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    int packed;
+    memcpy(&packed, plane + x, sizeof(packed));
+    __m128i values = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+    _mm_storeu_ps(luma + x, _mm_div_ps(_mm_cvtepi32_ps(values), scale));
+  }
+  planeRowToLuma(plane + x, luma + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void differenceRowToLumaSSE41(const uchar* marked,
+                                                                  const uchar* original,
+                                                                  double* luma, int cols) {
+  const __m128d scale = _mm_set1_pd(255.0);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    int m, o;
+    memcpy(&m, marked + x, sizeof(m));
+    memcpy(&o, original + x, sizeof(o));
+    __m128i difference = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(m)),
+                                       _mm_cvtepu8_epi32(_mm_cvtsi32_si128(o)));
+    _mm_storeu_pd(luma + x, _mm_div_pd(_mm_cvtepi32_pd(difference), scale));
+    _mm_storeu_pd(luma + x + 2,
+                  _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(difference, 8)), scale));
+  }
+  differenceRowToLuma(marked + x, original + x, luma + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void differenceRowToLumaSSE41(const uchar* marked,
+                                                                  const uchar* original,
+                                                                  float* luma, int cols) {
+  const __m128 scale = _mm_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    int m, o;
+    memcpy(&m, marked + x, sizeof(m));
+    memcpy(&o, original + x, sizeof(o));
+    __m128i difference = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(m)),
+                                       _mm_cvtepu8_epi32(_mm_cvtsi32_si128(o)));
+    _mm_storeu_ps(luma + x, _mm_div_ps(_mm_cvtepi32_ps(difference), scale));
+  }
+  differenceRowToLuma(marked + x, original + x, luma + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void lumaRowToPlaneSSE41(const double* luma, uchar* plane,
+                                                             int cols) {
+  const __m128d scale = _mm_set1_pd(255.0);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    __m128 low = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(luma + x), scale));
+    __m128 high = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(luma + x + 2), scale));
+    __m128 values = _mm_movelh_ps(low, high);
+    values = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    __m128i rounded = _mm_cvttps_epi32(roundClamped4(values));
+    __m128i words = _mm_packus_epi32(rounded, rounded);
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(plane + x, &packed, sizeof(packed));
+  }
+  lumaRowToPlane(luma + x, plane + x, cols - x);
+}
+
+__attribute__((target("sse4.1"))) void lumaRowToPlaneSSE41(const float* luma, uchar* plane,
+                                                             int cols) {
+  const __m128 scale = _mm_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 4 <= cols; x += 4) {
+    __m128 values = _mm_mul_ps(_mm_loadu_ps(luma + x), scale);
+    values = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    __m128i rounded = _mm_cvttps_epi32(roundClamped4(values));
+    __m128i words = _mm_packus_epi32(rounded, rounded);
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(plane + x, &packed, sizeof(packed));
+  }
+  lumaRowToPlane(luma + x, plane + x, cols - x);
+}
+
+#endif
+
+enum InstructionSet { SCALAR, SSE41, AVX2 };
+
+InstructionSet bestInstructionSet() {
+#ifdef LUMA_KERNELS_X86
+  static const InstructionSet best = __builtin_cpu_supports("avx2")     ? AVX2
+                                     : __builtin_cpu_supports("sse4.1") ? SSE41
+                                                                        : SCALAR;
+  return best;
+#else
+  return SCALAR;
+#endif
+}
+
+// the kernels in use, the best the CPU has unless useLumaKernels limits them
+std::atomic<int> selectedInstructionSet(-1);
+
+InstructionSet instructionSet() {
+  int selected = selectedInstructionSet;
+  return selected < 0 ? bestInstructionSet() : (InstructionSet)selected;
+}
+
+template <typename T>
+void planeRow(const uchar* plane, T* luma, int cols) {
+#ifdef LUMA_KERNELS_X86
+  if (instructionSet() == AVX2) return planeRowToLumaAVX2(plane, luma, cols);
+  if (instructionSet() == SSE41) return planeRowToLumaSSE41(plane, luma, cols);
+#endif
+  planeRowToLuma(plane, luma, cols);
+}
+
+template <typename T>
+void differenceRow(const uchar* marked, const uchar* original, T* luma, int cols) {
+#ifdef LUMA_KERNELS_X86
+  if (instructionSet() == AVX2) return differenceRowToLumaAVX2(marked, original, luma, cols);
+  if (instructionSet() == SSE41) return differenceRowToLumaSSE41(marked, original, luma, cols);
+#endif
+  differenceRowToLuma(marked, original, luma, cols);
+}
+
+template <typename T>
+void lumaRow(const T* luma, uchar* plane, int cols) {
+#ifdef LUMA_KERNELS_X86
+  if (instructionSet() == AVX2) return lumaRowToPlaneAVX2(luma, plane, cols);
+  if (instructionSet() == SSE41) return lumaRowToPlaneSSE41(luma, plane, cols);
+#endif
+  lumaRowToPlane(luma, plane, cols);
+}
+
+template <typename T>
+void planeToLumaRows(const cv::Mat& plane, T* lumaArray) {
+  CV_Assert(plane.type() == CV_8U);
+  cv::parallel_for_(cv::Range(0, plane.rows), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; y++)
+      planeRow(plane.ptr<uchar>(y), lumaArray + (size_t)y * plane.cols, plane.cols);
+  });
+}
+
+template <typename T>
+void differenceToLumaRows(const cv::Mat& marked, const cv::Mat& original, T* lumaArray) {
+  CV_Assert(marked.type() == CV_8U && original.type() == CV_8U);
+  CV_Assert(marked.size() == original.size());
+  cv::parallel_for_(cv::Range(0, marked.rows), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; y++)
+      differenceRow(marked.ptr<uchar>(y), original.ptr<uchar>(y),
+                    lumaArray + (size_t)y * marked.cols, marked.cols);
+  });
+}
+
+template <typename T>
+void lumaToPlaneRows(const T* lumaArray, cv::Mat& plane) {
+  CV_Assert(plane.type() == CV_8U);
+  cv::parallel_for_(cv::Range(0, plane.rows), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; y++)
+      lumaRow(lumaArray + (size_t)y * plane.cols, plane.ptr<uchar>(y), plane.cols);
+  });
+}
+
+}  // namespace
+
+std::string useLumaKernels(const std::string& name) {
+  const char* names[] = {"scalar", "sse4.1", "avx2"};
+  int asked = AVX2;
+  while (asked > SCALAR && name != names[asked]) asked--;
+  selectedInstructionSet = std::min(asked, (int)bestInstructionSet());
+  return names[instructionSet()];
+}
+
+void planeToLuma(const cv::Mat& plane, double* lumaArray) {
+  planeToLumaRows(plane, lumaArray);
+}
+
+void planeToLuma(const cv::Mat& plane, float* lumaArray) {
+  planeToLumaRows(plane, lumaArray);
+}
+
+void planeDifferenceToLuma(const cv::Mat& marked, const cv::Mat& original, double* lumaArray) {
+  differenceToLumaRows(marked, original, lumaArray);
+}
+
+void planeDifferenceToLuma(const cv::Mat& marked, const cv::Mat& original, float* lumaArray) {
+  differenceToLumaRows(marked, original, lumaArray);
+}
+
+void lumaToPlane(const double* lumaArray, cv::Mat& plane) {
+  lumaToPlaneRows(lumaArray, plane);
+}
+
+void lumaToPlane(const float* lumaArray, cv::Mat& plane) {
+  lumaToPlaneRows(lumaArray, plane);
+}
+
+void extractValue(const cv::Mat& image, cv::Mat& value) {
+  CV_Assert(image.type() == CV_8UC3);
+  value.create(image.size(), CV_8U);
+  cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; y++) {
+      const uchar* bgr = image.ptr<uchar>(y);
+      uchar* v = value.ptr<uchar>(y);
+      for (int x = 0; x < image.cols; x++, bgr += 3) {
+        v[x] = std::max(bgr[0], std::max(bgr[1], bgr[2]));
+      }
+    }
+  });
+}
+
+void replaceValue(cv::Mat& image, const cv::Mat& value) {
+  CV_Assert(image.type() == CV_8UC3 && value.type() == CV_8U);
+  CV_Assert(image.size() == value.size());
+  cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) {
+    for (int y = rows.start; y < rows.end; y++) {
+      uchar* bgr = image.ptr<uchar>(y);
+      const uchar* newValues = value.ptr<uchar>(y);
+      for (int x = 0; x < image.cols; x++, bgr += 3) {
+        int oldValue = std::max(bgr[0], std::max(bgr[1], bgr[2]));
+        int newValue = newValues[x];
+        if (oldValue == newValue) continue;
+
+        if (oldValue == 0) {
+          bgr[0] = bgr[1] = bgr[2] = (uchar)newValue;
+        } else {
+          // c * V' / V rounded to nearest, never above V' as c <= V
+          for (int c = 0; c < 3; c++)
+            bgr[c] = (uchar)((bgr[c] * newValue + oldValue / 2) / oldValue);
+        }
+      }
+    }
+  });
+}
@@ -0,0 +1,42 @@
+/* Header for LumaKernels */
+
+#ifndef LumaKernels_hpp
+#define LumaKernels_hpp
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Conversions between 8-bit luma planes (CV_8U, eg. the V channel) and the
+// normalised [0, 1] arrays the transforms work on. Rows are processed in
+// parallel with AVX2 or SSE4.1 when the CPU has them, and the results are bit
+// identical to the scalar loops they replace.
+
+// lumaArray[y * cols + x] = plane(y, x) / 255
+void planeToLuma(const cv::Mat& plane, double* lumaArray);
+void planeToLuma(const cv::Mat& plane, float* lumaArray);
+
+// lumaArray[y * cols + x] = (marked(y, x) - original(y, x)) / 255
+void planeDifferenceToLuma(const cv::Mat& marked, const cv::Mat& original, double* lumaArray);
+void planeDifferenceToLuma(const cv::Mat& marked, const cv::Mat& original, float* lumaArray);
+
+// plane(y, x) = round(lumaArray[y * cols + x] * 255) clamped to [0, 255], with
+// the scaled value rounded through float as mark-image always has
+void lumaToPlane(const double* lumaArray, cv::Mat& plane);
+void lumaToPlane(const float* lumaArray, cv::Mat& plane);
+
+// test hook: run the kernels above with "scalar", "sse4.1" or "avx2" (any
+// other name is scalar), or the best below it the CPU has, and return the name
+// of the set now in use
+std::string useLumaKernels(const std::string& name);
+
+// The value channel of a BGR image, V = max(B, G, R), without converting the
+// whole image to HSV (the same V that cvtColor(COLOR_BGR2HSV) produces)
+void extractValue(const cv::Mat& image, cv::Mat& value);
+
+// Give each pixel of a BGR image a new value, V' = value(y, x), by scaling its
+// channels by V' / V. Hue and saturation are kept without the quantisation of
+// a round trip through 8-bit HSV, and the largest channel becomes exactly V'
+// (black pixels, V = 0, become grey as they would from HSV).
+void replaceValue(cv::Mat& image, const cv::Mat& value);
+
+#endif /* LumaKernels_hpp */
@@ -0,0 +1,44 @@
+/* Header for LumaView */
+
+#ifndef LumaView_hpp
+#define LumaView_hpp
+
+#include <opencv2/opencv.hpp>
+
+// A caller-owned rows x cols array of T (float or double) with its rows stride
+// elements apart, e.g. a region of a larger luma array. insertMark and
+// extractMark transform and edit the array where it is, through a cv::Mat
+// header on the same memory, so they neither copy it nor allocate their own.
+// Buffers from cv::Mat are aligned for the vectorised kernels.
+template <typename T>
+struct LumaView {
+  LumaView() : data(nullptr), rows(0), cols(0), stride(0) {}
+  LumaView(T* data, int rows, int cols) : data(data), rows(rows), cols(cols), stride(cols) {}
+  LumaView(T* data, int rows, int cols, size_t stride)
+      : data(data), rows(rows), cols(cols), stride(stride) {}
+
+  // a view of a single channel cv::Mat of T, or of a region of one
+  explicit LumaView(cv::Mat& mat)
+      : data(mat.ptr<T>(0)), rows(mat.rows), cols(mat.cols), stride(mat.step1()) {
+    CV_Assert(mat.type() == cv::DataType<T>::type);
+  }
+
+  T* row(int i) const {
+    return data + i * stride;
+  }
+  T& operator()(int i, int j) const {
+    return data[i * stride + j];
+  }
+
+  // a cv::Mat header on the view's memory
+  cv::Mat mat() const {
+    return cv::Mat(rows, cols, cv::DataType<T>::type, data, stride * sizeof(T));
+  }
+
+  T* data;
+  int rows;
+  int cols;
+  size_t stride;  // elements from one row to the next
+};
+
+#endif /* LumaView_hpp */
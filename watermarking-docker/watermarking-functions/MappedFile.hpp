@@ -0,0 +1,36 @@
+/* Header for MappedFile */
+
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+// A memory mapping of a whole file, unmapped on destruction.
+// The mapping is private and copy on write: the file is never modified, but a
+// write through a cv::Mat over the data (eg. an in-place OpenCV call on a
+// sidecar's value plane) copies the pages it touches instead of faulting.
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  // map the file at path, returns false if it can't be opened or mapped
+  bool open(const std::string& path);
+  void close();
+
+  const unsigned char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  unsigned char* data_;
+  size_t size_;
+};
+
+#endif /* MappedFile_hpp */
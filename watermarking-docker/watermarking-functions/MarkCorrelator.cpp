@@ -0,0 +1,59 @@
+#include "MarkCorrelator.hpp"
+
+#include "BluesteinDft.hpp"
+
+template <typename T>
+MarkCorrelator<T>::MarkCorrelator(int height, int width, const T* extractedMark)
+    : height_(height), width_(width), bluestein_(bluesteinSuits(height, width)) {
+  forward(extractedMark, markSpectrum_);
+}
+
+template <typename T>
+MarkCorrelator<T>::MarkCorrelator(const MarkCorrelator& other)
+    : height_(other.height_),
+      width_(other.width_),
+      bluestein_(other.bluestein_),
+      markSpectrum_(other.markSpectrum_) {}
+
+// full complex spectrum of a real array (not padded, padding would alter the
+// circular correlation)
+template <typename T>
+void MarkCorrelator<T>::forward(const T* array, cv::Mat& spectrum) {
+  cv::Mat mat(height_, width_, cv::DataType<T>::type, const_cast<T*>(array));
+
+  if (bluestein_) {
+    cv::Mat planes[2] = {mat, cv::Mat::zeros(height_, width_, cv::DataType<T>::type)};
+    cv::merge(planes, 2, spectrum);
+    bluesteinDft(spectrum, spectrum);
+  } else {
+    cv::dft(mat, spectrum, cv::DFT_COMPLEX_OUTPUT, height_);
+  }
+}
+
+template <typename T>
+void MarkCorrelator<T>::correlate(const T* watermarkArray, T* correlationVals) {
+  forward(watermarkArray, arraySpectrum_);
+  correlateSpectrum(arraySpectrum_, correlationVals);
+}
+
+template <typename T>
+void MarkCorrelator<T>::correlateSpectrum(const cv::Mat& arraySpectrum, T* correlationVals) {
+  CV_Assert(arraySpectrum.type() == markSpectrum_.type());
+  CV_Assert(arraySpectrum.size() == markSpectrum_.size());
+
+  // mark spectrum times the conjugate of the array spectrum
+  cv::mulSpectrums(markSpectrum_, arraySpectrum, product_, 0, true);
+
+  // the correlation is real, write the real plane of the inverse transform
+  // straight into correlationVals
+  cv::Mat correlation(height_, width_, cv::DataType<T>::type, correlationVals);
+  if (bluestein_) {
+    bluesteinDft(product_, product_, cv::DFT_INVERSE | cv::DFT_SCALE);
+    cv::extractChannel(product_, correlation, 0);
+  } else {
+    cv::dft(product_, correlation, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+  }
+}
+
+template class MarkCorrelator<float>;
+template class MarkCorrelator<double>;
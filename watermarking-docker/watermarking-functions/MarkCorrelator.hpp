@@ -0,0 +1,43 @@
+/* Header for MarkCorrelator */
+
+#ifndef MarkCorrelator_hpp
+#define MarkCorrelator_hpp
+
+#include <opencv2/opencv.hpp>
+
+// Circular cross-correlation of one extracted mark with many watermark arrays.
+// The spectrum of the extracted mark is computed once, so each correlation
+// costs one forward transform of the watermark array, a pointwise multiply and
+// one inverse transform. T is float or double, as for fastCorrelation.
+template <typename T>
+class MarkCorrelator {
+ public:
+  // extractedMark is a (height x width) array in row major order
+  MarkCorrelator(int height, int width, const T* extractedMark);
+
+  // copies share the mark spectrum but not the buffers, so one correlator can
+  // be copied for each thread without transforming the mark again
+  MarkCorrelator(const MarkCorrelator& other);
+  MarkCorrelator& operator=(const MarkCorrelator&) = delete;
+
+  // correlationVals = fastCorrelation(extractedMark, watermarkArray), reusing
+  // buffers between calls (so a correlator is not shared between threads,
+  // give each thread a copy)
+  void correlate(const T* watermarkArray, T* correlationVals);
+
+  // the same, given the full complex spectrum of the watermark array (eg. from
+  // LegendreSpectrum) instead of the array
+  void correlateSpectrum(const cv::Mat& arraySpectrum, T* correlationVals);
+
+ private:
+  void forward(const T* array, cv::Mat& spectrum);
+
+  int height_;
+  int width_;
+  bool bluestein_;
+  cv::Mat markSpectrum_;
+  cv::Mat arraySpectrum_;
+  cv::Mat product_;
+};
+
+#endif /* MarkCorrelator_hpp */
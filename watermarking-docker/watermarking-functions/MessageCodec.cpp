@@ -0,0 +1,90 @@
+#include "MessageCodec.hpp"
+
+#include <cstdint>
+
+namespace {
+
+const int kBitsPerChar = 7;
+
+// an unsigned integer, least significant 32-bit limb first, no leading zeros
+typedef std::vector<uint32_t> Limbs;
+
+void trim(Limbs& n) {
+  while (!n.empty() && n.back() == 0) n.pop_back();
+}
+
+// n = n / divisor, returning the remainder
+uint32_t divideInPlace(Limbs& n, uint32_t divisor) {
+  uint64_t remainder = 0;
+  for (size_t i = n.size(); i-- > 0;) {
+    uint64_t current = (remainder << 32) | n[i];
+    n[i] = (uint32_t)(current / divisor);
+    remainder = current % divisor;
+  }
+  trim(n);
+  return (uint32_t)remainder;
+}
+
+// n = n * factor + addend
+void multiplyAddInPlace(Limbs& n, uint32_t factor, uint32_t addend) {
+  uint64_t carry = addend;
+  for (size_t i = 0; i < n.size(); i++) {
+    uint64_t current = (uint64_t)n[i] * factor + carry;
+    n[i] = (uint32_t)current;
+    carry = current >> 32;
+  }
+  if (carry != 0) n.push_back((uint32_t)carry);
+}
+
+size_t bitLength(const Limbs& n) {
+  if (n.empty()) return 0;
+  size_t length = (n.size() - 1) * 32;
+  for (uint32_t top = n.back(); top != 0; top >>= 1) length++;
+  return length;
+}
+
+bool bitAt(const Limbs& n, size_t bit) {
+  size_t limb = bit / 32;
+  return limb < n.size() && ((n[limb] >> (bit % 32)) & 1);
+}
+
+}  // namespace
+
+std::vector<int> encodeMessage(const std::string& message, int arraySize) {
+  // bit (char * 7 + j) of the number is bit (6 - j) of the character
+  Limbs n((message.size() * kBitsPerChar + 31) / 32, 0);
+  for (size_t c = 0; c < message.size(); c++) {
+    unsigned char value = message[c];
+    for (int j = 0; j < kBitsPerChar; j++) {
+      size_t bit = c * kBitsPerChar + j;
+      if ((value >> (kBitsPerChar - 1 - j)) & 1) n[bit / 32] |= 1u << (bit % 32);
+    }
+  }
+  trim(n);
+
+  std::vector<int> digits;
+  while (!n.empty()) digits.push_back((int)divideInPlace(n, (uint32_t)arraySize));
+  return digits;
+}
+
+std::string decodeMessage(const std::vector<int>& digits, int arraySize) {
+  Limbs n;
+  for (size_t i = digits.size(); i-- > 0;) {
+    multiplyAddInPlace(n, (uint32_t)arraySize, (uint32_t)digits[i]);
+  }
+  trim(n);
+
+  size_t length = bitLength(n);
+  size_t totalBits = length + length / kBitsPerChar;
+
+  std::string message;
+  message.reserve(totalBits / kBitsPerChar);
+  for (size_t c = 0; c < totalBits / kBitsPerChar; c++) {
+    unsigned char value = 0;
+    for (int j = 0; j < kBitsPerChar; j++) {
+      if (bitAt(n, c * kBitsPerChar + j)) value |= 1 << (kBitsPerChar - 1 - j);
+    }
+    message.append(1, (char)value);
+  }
+  return message;
+}
@@ -0,0 +1,27 @@
+/* Header for MessageCodec */
+
+#ifndef MessageCodec_hpp
+#define MessageCodec_hpp
+
+#include <string>
+#include <vector>
+
+// Conversion between 7-bit ASCII messages and the base arraySize (p^2) digits
+// embedded as watermark shifts, with 32-bit limbs. Each digit is one pass over
+// the limbs, so n digits take O(n^2): a few microseconds for the messages
+// marked in practice, but seconds for the largest payload (p - 2 digits at
+// p = 46337, the largest p whose p^2 fits an int), see MessageCodecTest.
+// The format is the original getShifts/getASCII one, quirks included:
+// - the 7 bits of each character are written most significant first, and the
+//   whole bit string is read as a number least significant bit first
+// - the digits are written least significant first
+// - decoding keeps bitLength / 7 zero bits past the highest set bit (for the
+//   high zero bits lost in the number) and drops any partial last character
+
+// the digits of message, empty for an empty (or all NUL) message
+std::vector<int> encodeMessage(const std::string& message, int arraySize);
+
+// the message the digits encode, empty for no digits
+std::string decodeMessage(const std::vector<int>& digits, int arraySize);
+
+#endif /* MessageCodec_hpp */
@@ -0,0 +1,538 @@
+#include "NativeFft.hpp"
+
+#include <atomic>
+#include <climits>
+#include <complex>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// larger prime factors are transformed with Bluestein's algorithm instead of
+// an O(radix) butterfly per point
+const int kMaxRadix = 31;
+
+// complex columns gathered into one contiguous panel for the column pass, so
+// each row is read once per panel as a run of 2 kPanelColumns values rather
+// than once per column
+const int kPanelColumns = 16;
+
+// the scratch buffers a thread keeps between transforms, the spectrum slot is
+// the calling thread's and the rest are used inside the parallel passes (which
+// may also run on the calling thread)
+enum WorkspaceSlot { kSpectrumSlot, kBufferSlot, kHalfSlot, kScratchSlot, kWorkspaceSlots };
+
+// scratch buffers allocated or grown, see nativeFftAllocations
+std::atomic<size_t> workspaceAllocations(0);
+
+// this thread's buffer for slot, at least size long, so a transform only
+// allocates the first time a thread meets a larger size
+template <typename T>
+std::complex<T>* workspace(WorkspaceSlot slot, size_t size) {
+  thread_local std::vector<std::complex<T> > buffers[kWorkspaceSlots];
+  std::vector<std::complex<T> >& buffer = buffers[slot];
+  if (buffer.size() < size) {
+    buffer.resize(size);
+    workspaceAllocations++;
+  }
+  return &buffer[0];
+}
+
+// the smallest 2^a 3^b 5^c >= n
+int smoothLength(int n) {
+  int best = INT_MAX;
+  for (long long twos = 1; twos < 2LL * n; twos *= 2)
+    for (long long threes = twos; threes < 2LL * n; threes *= 3)
+      for (long long fives = threes; fives < 2LL * n; fives *= 5)
+        if (fives >= n && fives < best) best = (int)fives;
+  return best;
+}
+
+// A complex transform of length n in one direction (unscaled), mixed radix
+// decimation in time with radix 4, 2, 3 and generic butterflies, or, when n
+// has a prime factor above kMaxRadix, a Bluestein convolution computed with a
+// smooth length plan.
+template <typename T>
+class ComplexPlan {
+ public:
+  typedef std::complex<T> Complex;
+
+  ComplexPlan(int n, bool inverse);
+
+  int size() const {
+    return n_;
+  }
+
+  // scratch (in Complex) execute needs
+  size_t scratchSize() const {
+    return bluestein_ ? (size_t)m_ + inner_->scratchSize() : (size_t)n_ + kMaxRadix;
+  }
+
+  // transform data in place
+  void execute(Complex* data, Complex* scratch) const;
+
+ private:
+  void work(Complex* out, const Complex* in, int stride, size_t stage, Complex* temp) const;
+  void butterfly2(Complex* out, int stride, int m) const;
+  void butterfly3(Complex* out, int stride, int m) const;
+  void butterfly4(Complex* out, int stride, int m) const;
+  void butterflyGeneric(Complex* out, int stride, int m, int radix, Complex* temp) const;
+
+  int n_;
+  bool inverse_;
+  std::vector<int> radices_;  // radix of each stage
+  std::vector<int> lengths_;  // length left after each stage's radix
+  std::vector<Complex> twiddles_;
+
+  // Bluestein: chirp w[j] = exp(-+ i pi j^2 / n), the kernel spectrum scaled by
+  // 1 / m, and a forward plan of the smooth length m
+  bool bluestein_;
+  int m_;
+  std::vector<Complex> chirp_;
+  std::vector<Complex> kernelSpectrum_;
+  std::shared_ptr<const ComplexPlan<T> > inner_;
+};
+
+// plans are built once per length and direction and shared by every call
+template <typename T>
+std::shared_ptr<const ComplexPlan<T> > complexPlan(int n, bool inverse) {
+  static std::map<std::pair<int, bool>, std::shared_ptr<const ComplexPlan<T> > > plans;
+  static std::recursive_mutex plansMutex;
+
+  // recursive, a Bluestein plan plans its inner length
+  std::lock_guard<std::recursive_mutex> lock(plansMutex);
+  auto found = plans.find(std::make_pair(n, inverse));
+  if (found != plans.end()) return found->second;
+
+  std::shared_ptr<const ComplexPlan<T> > plan(new ComplexPlan<T>(n, inverse));
+  plans[std::make_pair(n, inverse)] = plan;
+  return plan;
+}
+
+template <typename T>
+ComplexPlan<T>::ComplexPlan(int n, bool inverse)
+    : n_(n), inverse_(inverse), bluestein_(false), m_(0) {
+  // factor out 4s, then 2s, then odd factors in increasing order
+  int left = n;
+  for (int radix = 4; left > 1;) {
+    while (left % radix != 0) {
+      if (radix == 4)
+        radix = 2;
+      else if (radix == 2)
+        radix = 3;
+      else
+        radix += 2;
+      if ((long long)radix * radix > left) radix = left;
+    }
+    if (radix > kMaxRadix) {
+      bluestein_ = true;
+      break;
+    }
+    left /= radix;
+    radices_.push_back(radix);
+    lengths_.push_back(left);
+  }
+
+  // twiddles are computed in double whatever T is
+  double sign = inverse ? 1.0 : -1.0;
+  if (!bluestein_) {
+    twiddles_.resize(n);
+    for (int k = 0; k < n; k++) twiddles_[k] = (Complex)std::polar(1.0, sign * 2 * CV_PI * k / n);
+    return;
+  }
+
+  radices_.clear();
+  lengths_.clear();
+  m_ = smoothLength(2 * n - 1);
+  inner_ = complexPlan<T>(m_, false);
+
+  // j^2 is reduced mod 2n so the angle keeps its precision for large j
+  std::vector<std::complex<double> > chirp(n);
+  for (int j = 0; j < n; j++) {
+    double angle = CV_PI * (double)((long long)j * j % (2 * n)) / n;
+    chirp[j] = std::polar(1.0, sign * angle);
+  }
+  chirp_.assign(chirp.begin(), chirp.end());
+
+  kernelSpectrum_.assign(m_, Complex());
+  kernelSpectrum_[0] = (Complex)std::conj(chirp[0]);
+  for (int j = 1; j < n; j++)
+    kernelSpectrum_[j] = kernelSpectrum_[m_ - j] = (Complex)std::conj(chirp[j]);
+  std::vector<Complex> scratch(inner_->scratchSize());
+  inner_->execute(&kernelSpectrum_[0], &scratch[0]);
+  for (int j = 0; j < m_; j++) kernelSpectrum_[j] /= (T)m_;
+}
+
+template <typename T>
+void ComplexPlan<T>::execute(Complex* data, Complex* scratch) const {
+  if (n_ == 1) return;
+
+  if (!bluestein_) {
+    std::copy(data, data + n_, scratch);
+    work(data, scratch, 1, 0, scratch + n_);
+    return;
+  }
+
+  // X[k] = w[k] * sum_j (x[j] w[j]) conj(w[k - j]), a circular convolution of
+  // length m, the inverse transform being conj(forward(conj))
+  Complex* a = scratch;
+  Complex* innerScratch = scratch + m_;
+  for (int j = 0; j < n_; j++) a[j] = data[j] * chirp_[j];
+  std::fill(a + n_, a + m_, Complex());
+  inner_->execute(a, innerScratch);
+  for (int j = 0; j < m_; j++) a[j] = std::conj(a[j] * kernelSpectrum_[j]);
+  inner_->execute(a, innerScratch);
+  for (int j = 0; j < n_; j++) data[j] = std::conj(a[j]) * chirp_[j];
+}
+
+// out[0 .. radix * m) = transform of in[0], in[stride], ..., each of the radix
+// sub-sequences is transformed recursively, then combined
+template <typename T>
+void ComplexPlan<T>::work(Complex* out, const Complex* in, int stride, size_t stage,
+                          Complex* temp) const {
+  int radix = radices_[stage], m = lengths_[stage];
+  if (m == 1) {
+    for (int j = 0; j < radix; j++) out[j] = in[j * stride];
+  } else {
+    for (int j = 0; j < radix; j++) work(out + j * m, in + j * stride, stride * radix, stage + 1, temp);
+  }
+
+  if (radix == 2)
+    butterfly2(out, stride, m);
+  else if (radix == 3)
+    butterfly3(out, stride, m);
+  else if (radix == 4)
+    butterfly4(out, stride, m);
+  else
+    butterflyGeneric(out, stride, m, radix, temp);
+}
+
+template <typename T>
+void ComplexPlan<T>::butterfly2(Complex* out, int stride, int m) const {
+  for (int k = 0; k < m; k++) {
+    Complex t = out[k + m] * twiddles_[k * stride];
+    out[k + m] = out[k] - t;
+    out[k] += t;
+  }
+}
+
+template <typename T>
+void ComplexPlan<T>::butterfly3(Complex* out, int stride, int m) const {
+  T sine = twiddles_[stride * m].imag();
+  for (int k = 0; k < m; k++) {
+    Complex s1 = out[k + m] * twiddles_[k * stride];
+    Complex s2 = out[k + 2 * m] * twiddles_[2 * k * stride];
+    Complex sum = s1 + s2, difference = (s1 - s2) * sine;
+    Complex middle = out[k] - sum * (T)0.5;
+    out[k] += sum;
+    out[k + m] = Complex(middle.real() - difference.imag(), middle.imag() + difference.real());
+    out[k + 2 * m] = Complex(middle.real() + difference.imag(), middle.imag() - difference.real());
+  }
+}
+
+template <typename T>
+void ComplexPlan<T>::butterfly4(Complex* out, int stride, int m) const {
+  for (int k = 0; k < m; k++) {
+    Complex s0 = out[k + m] * twiddles_[k * stride];
+    Complex s1 = out[k + 2 * m] * twiddles_[2 * k * stride];
+    Complex s2 = out[k + 3 * m] * twiddles_[3 * k * stride];
+    Complex s5 = out[k] - s1;
+    Complex s4 = s0 - s2;
+    Complex s3 = s0 + s2;
+    out[k] += s1;
+    out[k + 2 * m] = out[k] - s3;
+    out[k] += s3;
+    if (inverse_) {
+      out[k + m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+      out[k + 3 * m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+    } else {
+      out[k + m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+      out[k + 3 * m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+    }
+  }
+}
+
+template <typename T>
+void ComplexPlan<T>::butterflyGeneric(Complex* out, int stride, int m, int radix,
+                                      Complex* temp) const {
+  for (int u = 0; u < m; u++) {
+    for (int q = 0; q < radix; q++) temp[q] = out[u + q * m];
+
+    for (int q1 = 0, k = u; q1 < radix; q1++, k += m) {
+      Complex sum = temp[0];
+      int twiddle = 0;
+      for (int q = 1; q < radix; q++) {
+        twiddle += stride * k;
+        if (twiddle >= n_) twiddle -= n_;
+        sum += temp[q] * twiddles_[twiddle];
+      }
+      out[k] = sum;
+    }
+  }
+}
+
+// split Z = fft(a + i b), a and b real, into A = fft(a) and B = fft(b)
+template <typename T>
+inline void splitPair(const std::complex<T>* z, int n, int k, std::complex<T>& a,
+                      std::complex<T>& b) {
+  std::complex<T> zk = z[k], zmk = std::conj(z[(n - k) % n]);
+  a = (zk + zmk) * (T)0.5;
+  std::complex<T> d = (zk - zmk) * (T)0.5;
+  b = std::complex<T>(d.imag(), -d.real());
+}
+
+// CCS packing of the first half of a real sequence's spectrum (n values at
+// step apart): re 0, re 1, im 1, re 2, im 2, ..., and re n/2 when n is even
+template <typename T>
+inline void packHalf(const std::complex<T>* half, int n, T* out, size_t step) {
+  out[0] = half[0].real();
+  for (int k = 1; 2 * k - 1 < n; k++) {
+    out[(2 * k - 1) * step] = half[k].real();
+    if (2 * k < n) out[2 * k * step] = half[k].imag();
+  }
+}
+
+// the full (hermitian) spectrum of a CCS packed real sequence
+template <typename T>
+inline void unpackFull(const T* in, int n, size_t step, std::complex<T>* full) {
+  full[0] = std::complex<T>(in[0], 0);
+  for (int k = 1; 2 * k - 1 < n; k++) {
+    T im = 2 * k < n ? in[2 * k * step] : 0;
+    full[k] = std::complex<T>(in[(2 * k - 1) * step], im);
+    full[n - k] = std::conj(full[k]);
+  }
+}
+
+// transform the real sequences x and y (n values at step apart, y may be
+// null) into their CCS packed spectra in place, with one complex transform
+template <typename T>
+void forwardRealPair(T* x, T* y, int n, size_t step, const ComplexPlan<T>& plan,
+                     std::complex<T>* z, std::complex<T>* half, std::complex<T>* scratch) {
+  for (int j = 0; j < n; j++) z[j] = std::complex<T>(x[j * step], y ? y[j * step] : 0);
+  plan.execute(z, scratch);
+
+  std::complex<T> b;
+  for (int k = 0; k <= n / 2; k++) splitPair(z, n, k, half[k], b);
+  packHalf(half, n, x, step);
+  if (y) {
+    for (int k = 0; k <= n / 2; k++) splitPair(z, n, k, b, half[k]);
+    packHalf(half, n, y, step);
+  }
+}
+
+// the inverse of forwardRealPair (unscaled)
+template <typename T>
+void inverseRealPair(T* x, T* y, int n, size_t step, const ComplexPlan<T>& plan,
+                     std::complex<T>* z, std::complex<T>* full, std::complex<T>* scratch) {
+  unpackFull(x, n, step, z);
+  if (y) {
+    unpackFull(y, n, step, full);
+    for (int k = 0; k < n; k++) z[k] += std::complex<T>(-full[k].imag(), full[k].real());
+  }
+  plan.execute(z, scratch);
+
+  for (int j = 0; j < n; j++) {
+    x[j * step] = z[j].real();
+    if (y) y[j * step] = z[j].imag();
+  }
+}
+
+// A rows x cols real transform in OpenCV's CCS layout: real row transforms
+// (two rows per complex transform), then column transforms, the real first
+// (and for even cols, last) columns paired in one complex transform and each
+// (re, im) pair of columns transformed as one complex column. The inverse
+// runs the same passes in reverse.
+// - row pairs are spread over OpenCV's thread pool (cv::parallel_for_, so
+//   cv::setNumThreads(1) keeps the transform on the calling thread)
+// - complex columns are transposed into contiguous panels of kPanelColumns,
+//   transformed and transposed back, the panels spread over the pool too
+// - the matrix may be a region of a larger one (rows step() apart), it is
+//   transformed where it is, with the inverse's scaling folded into its last
+//   pass, and all scratch comes from the threads' workspaces
+template <typename T>
+class RealPlan : public FftPlan {
+ public:
+  RealPlan(int rows, int cols, bool inverse)
+      : rows_(rows),
+        cols_(cols),
+        inverse_(inverse),
+        rowPlan_(complexPlan<T>(cols, inverse)),
+        columnPlan_(complexPlan<T>(rows, inverse)) {}
+
+  void execute(cv::Mat& mat) const {
+    CV_Assert(mat.rows == rows_ && mat.cols == cols_ && mat.depth() == cv::DataType<T>::depth &&
+              mat.channels() == 1);
+    T* data = mat.ptr<T>(0);
+    size_t stride = mat.step1();
+
+    if (inverse_) {
+      columns(data, stride);
+      rows(data, stride);
+    } else {
+      rows(data, stride);
+      columns(data, stride);
+    }
+  }
+
+  // Only the block's coefficients are computed: the row pass keeps the
+  // complex bins 1..(block cols + 1) / 2 of each row (and doesn't write back),
+  // and only those bins' columns are transformed, so a wide image skips most
+  // of the column pass. The block must stay clear of the real columns, which
+  // it does for any p up to min(rows, cols) - 2.
+  void executeBlock(cv::Mat& mat, cv::Mat& block) const {
+    int bins = (block.cols + 1) / 2;
+    if (inverse_ || block.rows >= rows_ || 2 * bins >= cols_) {
+      FftPlan::executeBlock(mat, block);
+      return;
+    }
+    CV_Assert(mat.rows == rows_ && mat.cols == cols_ && mat.depth() == cv::DataType<T>::depth &&
+              mat.channels() == 1 && block.depth() == mat.depth() && block.channels() == 1);
+    const T* data = mat.ptr<T>(0);
+    size_t stride = mat.step1();
+
+    // the kept bins of every row
+    Complex* spectrum = workspace<T>(kSpectrumSlot, (size_t)rows_ * bins);
+    cv::parallel_for_(cv::Range(0, (rows_ + 1) / 2), [&](const cv::Range& range) {
+      Complex* z = workspace<T>(kBufferSlot, cols_);
+      Complex* scratch = workspace<T>(kScratchSlot, rowPlan_->scratchSize());
+      for (int pair = range.start; pair < range.end; pair++) {
+        int r = 2 * pair;
+        bool second = r + 1 < rows_;
+        const T* x = data + (size_t)r * stride;
+        for (int j = 0; j < cols_; j++) z[j] = Complex(x[j], second ? x[j + stride] : 0);
+        rowPlan_->execute(z, scratch);
+
+        Complex* first = spectrum + (size_t)r * bins;
+        Complex b;
+        for (int bin = 1; bin <= bins; bin++) {
+          splitPair(z, cols_, bin, first[bin - 1], b);
+          if (second) first[bins + bin - 1] = b;
+        }
+      }
+    });
+
+    // transpose panels of bins into contiguous columns and transform them, CCS
+    // column 2 bin - 1 holds the real parts and 2 bin the imaginary parts
+    int panels = (bins + kPanelColumns - 1) / kPanelColumns;
+    cv::parallel_for_(cv::Range(0, panels), [&](const cv::Range& range) {
+      Complex* panel = workspace<T>(kBufferSlot, (size_t)kPanelColumns * rows_);
+      Complex* scratch = workspace<T>(kScratchSlot, columnPlan_->scratchSize());
+      for (int index = range.start; index < range.end; index++) {
+        int firstBin = index * kPanelColumns;
+        int count = std::min(kPanelColumns, bins - firstBin);
+        for (int r = 0; r < rows_; r++) {
+          const Complex* row = spectrum + (size_t)r * bins + firstBin;
+          for (int c = 0; c < count; c++) panel[(size_t)c * rows_ + r] = row[c];
+        }
+        for (int c = 0; c < count; c++) {
+          Complex* column = panel + (size_t)c * rows_;
+          columnPlan_->execute(column, scratch);
+          int j = 2 * (firstBin + c);
+          for (int i = 0; i < block.rows; i++) {
+            T* out = block.ptr<T>(i);
+            out[j] = column[i + 1].real();
+            if (j + 1 < block.cols) out[j + 1] = column[i + 1].imag();
+          }
+        }
+      }
+    });
+  }
+
+ private:
+  typedef std::complex<T> Complex;
+
+  // rows stride elements apart, the inverse is scaled by 1 / (rows cols) here
+  void rows(T* data, size_t stride) const {
+    T scale = (T)(1.0 / ((double)rows_ * cols_));
+    cv::parallel_for_(cv::Range(0, (rows_ + 1) / 2), [&](const cv::Range& range) {
+      Complex* z = workspace<T>(kBufferSlot, cols_);
+      Complex* half = workspace<T>(kHalfSlot, cols_);
+      Complex* scratch = workspace<T>(kScratchSlot, rowPlan_->scratchSize());
+      for (int pair = range.start; pair < range.end; pair++) {
+        T* x = data + (size_t)2 * pair * stride;
+        T* y = 2 * pair + 1 < rows_ ? x + stride : nullptr;
+        if (!inverse_) {
+          forwardRealPair(x, y, cols_, 1, *rowPlan_, z, half, scratch);
+          continue;
+        }
+        inverseRealPair(x, y, cols_, 1, *rowPlan_, z, half, scratch);
+        for (int j = 0; j < cols_; j++) x[j] *= scale;
+        if (y)
+          for (int j = 0; j < cols_; j++) y[j] *= scale;
+      }
+    });
+  }
+
+  void columns(T* data, size_t stride) const {
+    // the real columns
+    {
+      Complex* z = workspace<T>(kBufferSlot, rows_);
+      Complex* half = workspace<T>(kHalfSlot, rows_);
+      Complex* scratch = workspace<T>(kScratchSlot, columnPlan_->scratchSize());
+      T* last = cols_ % 2 == 0 && cols_ > 1 ? data + cols_ - 1 : nullptr;
+      if (inverse_)
+        inverseRealPair(data, last, rows_, stride, *columnPlan_, z, half, scratch);
+      else
+        forwardRealPair(data, last, rows_, stride, *columnPlan_, z, half, scratch);
+    }
+
+    // the complex columns k = 1 .. (cols - 1) / 2, at (2k - 1, 2k)
+    int complexColumns = (cols_ - 1) / 2;
+    int panels = (complexColumns + kPanelColumns - 1) / kPanelColumns;
+    cv::parallel_for_(cv::Range(0, panels), [&](const cv::Range& range) {
+      Complex* panel = workspace<T>(kBufferSlot, (size_t)kPanelColumns * rows_);
+      Complex* scratch = workspace<T>(kScratchSlot, columnPlan_->scratchSize());
+      for (int index = range.start; index < range.end; index++) {
+        int first = index * kPanelColumns;
+        int count = std::min(kPanelColumns, complexColumns - first);
+        T* origin = data + 2 * first + 1;
+
+        for (int r = 0; r < rows_; r++) {
+          const T* row = origin + (size_t)r * stride;
+          for (int b = 0; b < count; b++)
+            panel[(size_t)b * rows_ + r] = Complex(row[2 * b], row[2 * b + 1]);
+        }
+        for (int b = 0; b < count; b++) columnPlan_->execute(panel + (size_t)b * rows_, scratch);
+        for (int r = 0; r < rows_; r++) {
+          T* row = origin + (size_t)r * stride;
+          for (int b = 0; b < count; b++) {
+            const Complex& value = panel[(size_t)b * rows_ + r];
+            row[2 * b] = value.real();
+            row[2 * b + 1] = value.imag();
+          }
+        }
+      }
+    });
+  }
+
+  int rows_;
+  int cols_;
+  bool inverse_;
+  std::shared_ptr<const ComplexPlan<T> > rowPlan_;
+  std::shared_ptr<const ComplexPlan<T> > columnPlan_;
+};
+
+class NativeFftBackend : public FftBackend {
+ public:
+  const char* name() const {
+    return "native";
+  }
+
+  std::shared_ptr<const FftPlan> plan(int rows, int cols, int depth, bool inverse) const {
+    CV_Assert(depth == CV_32F || depth == CV_64F);
+    if (depth == CV_32F) return std::make_shared<RealPlan<float> >(rows, cols, inverse);
+    return std::make_shared<RealPlan<double> >(rows, cols, inverse);
+  }
+};
+
+}  // namespace
+
+const FftBackend& nativeFftBackend() {
+  static NativeFftBackend backend;
+  return backend;
+}
+
+size_t nativeFftAllocations() {
+  return workspaceAllocations;
+}
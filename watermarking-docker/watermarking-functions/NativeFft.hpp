@@ -0,0 +1,23 @@
+/* Header for NativeFft */
+
+#ifndef NativeFft_hpp
+#define NativeFft_hpp
+
+#include "FftBackend.hpp"
+
+// The "native" transform backend, with no library behind it: mixed radix
+// complex transforms (radix 4, 2, 3 and generic butterflies up to 31, larger
+// prime factors by Bluestein's algorithm) run as a row-column 2d real
+// transform, two real rows or columns per complex transform. Row pairs and
+// panels of columns (transposed into contiguous buffers between the passes)
+// are spread over OpenCV's thread pool. The complex plans of each length are
+// cached, so a 2d plan only costs its twiddles once. Scratch buffers are
+// kept per thread, so repeat transforms of a size don't allocate.
+const FftBackend& nativeFftBackend();
+
+// test hook: the scratch buffers the native transforms have allocated (or
+// grown) so far, which stays put over repeat transforms of sizes each thread
+// has already run
+size_t nativeFftAllocations();
+
+#endif /* NativeFft_hpp */
@@ -0,0 +1,168 @@
+#include "OriginalSidecar.hpp"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "LumaKernels.hpp"
+#include "WatermarkDetection.hpp"
+
+namespace {
+
+// bump when the layout or the meaning of the block changes
+const uint32_t kSidecarVersion = 2;
+const char kSidecarMagic[4] = {'W', 'M', 'O', 'S'};
+const char* kSidecarExtension = ".wmo";
+
+struct SidecarHeader {
+  char magic[4];
+  uint32_t version;
+  int32_t rows;
+  int32_t cols;
+  int32_t p;
+  int32_t hasBlock;
+  uint64_t planeOffset;  // both sections are 16-byte aligned
+  uint64_t blockOffset;
+  int32_t regionX;  // version 2 on, version 1 headers end here
+  int32_t regionY;
+  int32_t regionWidth;
+  int32_t regionHeight;
+};
+
+const size_t kVersion1HeaderSize = offsetof(SidecarHeader, regionX);
+
+size_t headerSizeFor(uint32_t version) {
+  return version == 1 ? kVersion1HeaderSize : sizeof(SidecarHeader);
+}
+
+uint64_t align16(uint64_t offset) {
+  return (offset + 15) & ~uint64_t(15);
+}
+
+SidecarHeader headerFor(uint32_t version, int rows, int cols, const cv::Rect& region, int p,
+                        bool withBlock) {
+  SidecarHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSidecarMagic, sizeof(header.magic));
+  header.version = version;
+  header.rows = rows;
+  header.cols = cols;
+  header.p = p;
+  header.hasBlock = withBlock ? 1 : 0;
+  header.planeOffset = align16(headerSizeFor(version));
+  header.blockOffset = withBlock ? align16(header.planeOffset + (uint64_t)rows * cols) : 0;
+  if (version > 1) {
+    header.regionX = region.x;
+    header.regionY = region.y;
+    header.regionWidth = region.width;
+    header.regionHeight = region.height;
+  }
+  return header;
+}
+
+uint64_t fileSizeFor(const SidecarHeader& header) {
+  if (header.hasBlock) return header.blockOffset + (uint64_t)header.p * header.p * sizeof(double);
+  return header.planeOffset + (uint64_t)header.rows * header.cols;
+}
+
+}  // namespace
+
+bool OriginalSidecar::write(const std::string& path, const cv::Mat& valuePlane,
+                            const cv::Rect& region, int p, bool withBlock) {
+  if (valuePlane.type() != CV_8U) return false;
+
+  int rows = valuePlane.rows, cols = valuePlane.cols;
+  SidecarHeader header = headerFor(kSidecarVersion, rows, cols, region, p, withBlock);
+
+  std::vector<double> block;
+  if (withBlock) {
+    cv::Mat luma(region.size(), CV_64F);
+    planeToLuma(valuePlane(region), luma.ptr<double>(0));
+    block.resize(p * p);
+    extractMark(LumaView<double>(luma), LumaView<double>(block.data(), p, p));
+  }
+
+  // write to a temporary file then rename, so readers never map a partial file
+  std::ostringstream tmpPath;
+  tmpPath << path << ".tmp" << getpid();
+
+  {
+    std::ofstream out(tmpPath.str().c_str(), std::ios::binary);
+    std::vector<char> padding(16, 0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding.data(), header.planeOffset - sizeof(header));
+    for (int y = 0; y < rows; y++) {
+      out.write(reinterpret_cast<const char*>(valuePlane.ptr<uchar>(y)), cols);
+    }
+    if (withBlock) {
+      out.write(padding.data(), header.blockOffset - (header.planeOffset + (uint64_t)rows * cols));
+      out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(double));
+    }
+    if (!out) {
+      unlink(tmpPath.str().c_str());
+      return false;
+    }
+  }
+
+  if (rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+    unlink(tmpPath.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+bool OriginalSidecar::open(const std::string& path) {
+  valuePlane_ = cv::Mat();
+  block_ = nullptr;
+  if (!file_.open(path)) return false;
+
+  // check the header describes exactly this file
+  SidecarHeader header;
+  memset(&header, 0, sizeof(header));
+  if (file_.size() < kVersion1HeaderSize) return false;
+  memcpy(&header, file_.data(), kVersion1HeaderSize);
+  if (memcmp(header.magic, kSidecarMagic, sizeof(header.magic)) != 0 ||
+      (header.version != 1 && header.version != kSidecarVersion) ||
+      file_.size() < headerSizeFor(header.version)) {
+    return false;
+  }
+  memcpy(&header, file_.data(), headerSizeFor(header.version));
+
+  cv::Rect region(0, 0, header.cols, header.rows);
+  if (header.version > 1) {
+    region = cv::Rect(header.regionX, header.regionY, header.regionWidth, header.regionHeight);
+  }
+  if (header.rows <= 0 || header.cols <= 0 || region.x < 0 || region.y < 0 ||
+      region.width <= 0 || region.height <= 0 || region.x + region.width > header.cols ||
+      region.y + region.height > header.rows || header.p <= 0 ||
+      header.p > region.height - 2 || header.p > region.width - 2) {
+    return false;
+  }
+  SidecarHeader expected = headerFor(header.version, header.rows, header.cols, region, header.p,
+                                     header.hasBlock != 0);
+  if (memcmp(&header, &expected, sizeof(header)) != 0 || file_.size() != fileSizeFor(header)) {
+    return false;
+  }
+
+  rows_ = header.rows;
+  cols_ = header.cols;
+  region_ = region;
+  p_ = header.p;
+  valuePlane_ = cv::Mat(rows_, cols_, CV_8U,
+                        const_cast<unsigned char*>(file_.data() + header.planeOffset));
+  if (header.hasBlock) {
+    block_ = reinterpret_cast<const double*>(file_.data() + header.blockOffset);
+  }
+  return true;
+}
+
+bool isOriginalSidecar(const std::string& path) {
+  size_t length = strlen(kSidecarExtension);
+  return path.size() > length && path.compare(path.size() - length, length, kSidecarExtension) == 0;
+}
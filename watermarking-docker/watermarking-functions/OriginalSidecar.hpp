@@ -0,0 +1,72 @@
+/* Header for OriginalSidecar */
+
+#ifndef OriginalSidecar_hpp
+#define OriginalSidecar_hpp
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+#include "MappedFile.hpp"
+
+// A preprocessed original (.wmo) written at mark time, so detection can skip
+// decoding the original image and extracting its value plane.
+// It holds the value plane (8-bit), the size, the region the mark was added to,
+// p, and optionally the p x p block of the region's transform that extractMark
+// reads. With the block, detection in double precision extracts the marked
+// plane alone and subtracts it (the extraction is linear), without reading the
+// plane at all.
+class OriginalSidecar {
+ public:
+  OriginalSidecar() : rows_(0), cols_(0), p_(0), block_(nullptr) {}
+  OriginalSidecar(const OriginalSidecar&) = delete;
+  OriginalSidecar& operator=(const OriginalSidecar&) = delete;
+
+  // write a sidecar for an original's value plane (CV_8U) marked in region,
+  // computing the region's extracted block when withBlock
+  static bool write(const std::string& path, const cv::Mat& valuePlane, const cv::Rect& region,
+                    int p, bool withBlock);
+
+  // map the sidecar at path, returns false if it is missing or not a sidecar
+  // of this version (version 1 sidecars, written before regions, are read as
+  // marked over the whole plane)
+  bool open(const std::string& path);
+
+  int rows() const {
+    return rows_;
+  }
+  int cols() const {
+    return cols_;
+  }
+  int p() const {
+    return p_;
+  }
+  const cv::Rect& region() const {
+    return region_;
+  }
+
+  // the value plane, a view of the mapping (writes to it stay private to the
+  // process, see MappedFile)
+  const cv::Mat& valuePlane() const {
+    return valuePlane_;
+  }
+
+  // extractMark's p x p output for the region of the value plane / 255 in
+  // double precision, nullptr when the sidecar was written without it
+  const double* block() const {
+    return block_;
+  }
+
+ private:
+  MappedFile file_;
+  int rows_;
+  int cols_;
+  int p_;
+  cv::Rect region_;
+  cv::Mat valuePlane_;
+  const double* block_;
+};
+
+// whether path names a sidecar rather than an image
+bool isOriginalSidecar(const std::string& path);
+
+#endif /* OriginalSidecar_hpp */
@@ -0,0 +1,78 @@
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// the first number in the file at path, false if it has none (eg. "max")
+bool readNumber(const std::string& path, size_t& number) {
+  std::ifstream file(path.c_str());
+  return static_cast<bool>(file >> number);
+}
+
+// the room left under the process's cgroup memory limit (v2, then v1),
+// false when there is no limit
+bool cgroupRoom(size_t& room) {
+  size_t limit, usage;
+  if ((readNumber("/sys/fs/cgroup/memory.max", limit) &&
+       readNumber("/sys/fs/cgroup/memory.current", usage)) ||
+      (readNumber("/sys/fs/cgroup/memory/memory.limit_in_bytes", limit) &&
+       readNumber("/sys/fs/cgroup/memory/memory.usage_in_bytes", usage))) {
+    room = limit > usage ? limit - usage : 0;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int defaultWorkerCount() {
+  unsigned int count = std::thread::hardware_concurrency();
+  return count > 0 ? (int)count : 1;
+}
+
+bool availableMemory(size_t& bytes) {
+  bool known = false;
+  std::ifstream meminfo("/proc/meminfo");
+  std::string field;
+  size_t kilobytes;
+  while (meminfo >> field >> kilobytes) {
+    if (field == "MemAvailable:") {
+      bytes = kilobytes * 1024;
+      known = true;
+      break;
+    }
+    meminfo.ignore(256, '\n');
+  }
+
+  size_t room;
+  if (cgroupRoom(room)) {
+    bytes = known ? std::min(bytes, room) : room;
+    known = true;
+  }
+  return known;
+}
+
+int workersWithinMemory(int workerCount, size_t workerBytes) {
+  size_t available;
+  if (!availableMemory(available) || workerBytes == 0) return workerCount;
+  size_t fit = available / 2 / workerBytes;
+  return (int)std::max<size_t>(1, std::min<size_t>(workerCount, fit));
+}
+
+void runWorkers(int workerCount, const std::function<void(int)>& body) {
+  std::vector<std::thread> threads;
+  for (int worker = 1; worker < workerCount; worker++) {
+    threads.push_back(std::thread(body, worker));
+  }
+
+  body(0);
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+}
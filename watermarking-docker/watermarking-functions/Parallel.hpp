@@ -0,0 +1,24 @@
+/* Header for Parallel */
+
+#ifndef Parallel_hpp
+#define Parallel_hpp
+
+#include <cstddef>
+#include <functional>
+
+// number of workers to use when none is requested (one per hardware thread)
+int defaultWorkerCount();
+
+// bytes of memory the process can still allocate: the system's available
+// memory, or less when a container (cgroup) limit is closer, false if unknown
+bool availableMemory(size_t& bytes);
+
+// workerCount, reduced so that workers needing workerBytes each fit in half the
+// available memory (always at least one, and unchanged if that is unknown)
+int workersWithinMemory(int workerCount, size_t workerBytes);
+
+// run body(worker) on each of workerCount threads (worker = 0..workerCount-1)
+// and wait for them all to finish, the calling thread runs worker 0
+void runWorkers(int workerCount, const std::function<void(int)>& body);
+
+#endif /* Parallel_hpp */
@@ -0,0 +1,185 @@
+#include "PatternCache.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+namespace {
+
+// bump when the pattern for a given key would change (eg. a new array generator)
+// - 2: framed messages, and column shifts that no longer overflow for large p
+// - 3: the transform precision is part of the key
+const uint32_t kPatternVersion = 3;
+const char kPatternMagic[4] = {'W', 'M', 'P', 'C'};
+const char* kPatternExtension = ".wmp";
+
+struct PatternHeader {
+  char magic[4];
+  uint32_t version;
+  int32_t rows;
+  int32_t cols;
+  int32_t p;
+  int32_t strength;
+  int32_t framed;
+  int32_t depth;
+  uint32_t messageLength;
+  uint32_t dataOffset;  // the float data is 16-byte aligned after the message
+};
+
+PatternHeader headerFor(int rows, int cols, int p, const std::string& message, int strength,
+                        bool framed, int depth) {
+  PatternHeader header;
+  memcpy(header.magic, kPatternMagic, sizeof(header.magic));
+  header.version = kPatternVersion;
+  header.rows = rows;
+  header.cols = cols;
+  header.p = p;
+  header.strength = strength;
+  header.framed = framed ? 1 : 0;
+  header.depth = depth;
+  header.messageLength = (uint32_t)message.size();
+  header.dataOffset = (uint32_t)((sizeof(PatternHeader) + message.size() + 15) & ~size_t(15));
+  return header;
+}
+
+// 64-bit FNV-1a
+uint64_t fnv1a(const void* data, size_t length, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool hasExtension(const std::string& name, const std::string& extension) {
+  return name.size() > extension.size() &&
+         name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+}  // namespace
+
+PatternCache::PatternCache(const std::string& directory, size_t budgetBytes)
+    : directory_(directory), budgetBytes_(budgetBytes) {
+  if (!directory_.empty()) mkdir(directory_.c_str(), 0755);
+}
+
+std::string PatternCache::pathFor(int rows, int cols, int p, const std::string& message,
+                                  int strength, bool framed, int depth) const {
+  PatternHeader header = headerFor(rows, cols, p, message, strength, framed, depth);
+  uint64_t hash = fnv1a(&header, sizeof(header), 14695981039346656037ULL);
+  hash = fnv1a(message.data(), message.size(), hash);
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+  return directory_ + "/" + name + kPatternExtension;
+}
+
+bool PatternCache::load(int rows, int cols, int p, const std::string& message, int strength,
+                        bool framed, int depth, WatermarkPattern& pattern) {
+  std::string path = pathFor(rows, cols, p, message, strength, framed, depth);
+
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->open(path)) return false;
+
+  // the key is a hash, so check the stored parameters really match
+  PatternHeader expected = headerFor(rows, cols, p, message, strength, framed, depth);
+  size_t expectedSize = expected.dataOffset + (size_t)rows * cols * sizeof(float);
+  if (file->size() != expectedSize || memcmp(file->data(), &expected, sizeof(expected)) != 0 ||
+      memcmp(file->data() + sizeof(expected), message.data(), message.size()) != 0) {
+    return false;
+  }
+
+  // refresh the modification time, used as the recency for eviction
+  utimes(path.c_str(), nullptr);
+
+  cv::Mat mapped(rows, cols, CV_32F, const_cast<unsigned char*>(file->data() + expected.dataOffset));
+  pattern = WatermarkPattern(mapped, file);
+  return true;
+}
+
+bool PatternCache::store(int rows, int cols, int p, const std::string& message, int strength,
+                         bool framed, int depth, const WatermarkPattern& pattern) {
+  if (pattern.rows() != rows || pattern.cols() != cols || pattern.mat().type() != CV_32F) {
+    return false;
+  }
+
+  std::string path = pathFor(rows, cols, p, message, strength, framed, depth);
+  PatternHeader header = headerFor(rows, cols, p, message, strength, framed, depth);
+
+  // write to a temporary file then rename, so readers never map a partial file
+  std::ostringstream tmpPath;
+  tmpPath << path << ".tmp" << getpid();
+
+  {
+    std::ofstream out(tmpPath.str().c_str(), std::ios::binary);
+    std::vector<char> padding(header.dataOffset - sizeof(header) - message.size(), 0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(message.data(), message.size());
+    out.write(padding.data(), padding.size());
+    for (int y = 0; y < rows; y++) {
+      out.write(reinterpret_cast<const char*>(pattern.mat().ptr<float>(y)), cols * sizeof(float));
+    }
+    if (!out) {
+      unlink(tmpPath.str().c_str());
+      return false;
+    }
+  }
+
+  if (rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+    unlink(tmpPath.str().c_str());
+    return false;
+  }
+
+  evict();
+  return true;
+}
+
+// remove the least recently used patterns until the directory fits the budget,
+// always keeping the most recent one
+void PatternCache::evict() {
+  struct Entry {
+    std::string path;
+    size_t size;
+    time_t modified;
+  };
+  std::vector<Entry> entries;
+  size_t total = 0;
+
+  DIR* dir = opendir(directory_.c_str());
+  if (dir == nullptr) return;
+  for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (!hasExtension(name, kPatternExtension)) continue;
+
+    struct stat st;
+    std::string path = directory_ + "/" + name;
+    if (stat(path.c_str(), &st) != 0) continue;
+
+    Entry e = {path, (size_t)st.st_size, st.st_mtime};
+    entries.push_back(e);
+    total += e.size;
+  }
+  closedir(dir);
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.modified < b.modified; });
+
+  for (size_t i = 0; i + 1 < entries.size() && total > budgetBytes_; i++) {
+    // another process may have evicted it already, either way it's gone
+    unlink(entries[i].path.c_str());
+    total -= entries[i].size;
+  }
+}
@@ -0,0 +1,41 @@
+/* Header for PatternCache */
+
+#ifndef PatternCache_hpp
+#define PatternCache_hpp
+
+#include <cstddef>
+#include <string>
+
+#include "WatermarkPattern.hpp"
+
+// A directory of precomputed watermark patterns, one file per
+// (rows, cols, p, message, strength, framed, depth), so repeat marks of the same
+// message at the same resolution skip generating and transforming the watermark.
+// depth is the precision the pattern was transformed in (CV_64F or CV_32F), the
+// stored pattern is float either way but the two differ in rounding, so a
+// --float pattern is never handed to a double precision mark or back.
+// Patterns are memory mapped when loaded. Hits refresh a file's modification
+// time and the least recently used files are evicted once the directory grows
+// past its budget.
+class PatternCache {
+ public:
+  PatternCache(const std::string& directory, size_t budgetBytes);
+
+  // returns false on a miss (or if the cached file is unreadable)
+  bool load(int rows, int cols, int p, const std::string& message, int strength, bool framed,
+            int depth, WatermarkPattern& pattern);
+
+  // write the pattern to the cache then evict down to the budget
+  bool store(int rows, int cols, int p, const std::string& message, int strength, bool framed,
+             int depth, const WatermarkPattern& pattern);
+
+ private:
+  std::string pathFor(int rows, int cols, int p, const std::string& message, int strength,
+                      bool framed, int depth) const;
+  void evict();
+
+  std::string directory_;
+  size_t budgetBytes_;
+};
+
+#endif /* PatternCache_hpp */
@@ -10,6 +10,10 @@
 
 #include <algorithm>
 #include <boost/math/special_functions/prime.hpp>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 
@@ -72,7 +76,11 @@ void saveImageToFile(std::string file_name, cv::Mat& imageMat) {
 }
 
 int largestPrimeFor(cv::Mat& imgMat) {
-  int minImgDim = std::min(imgMat.rows, imgMat.cols);
+  return largestPrimeFor(imgMat.rows, imgMat.cols);
+}
+
+int largestPrimeFor(int rows, int cols) {
+  int minImgDim = std::min(rows, cols);
 
   // we avoid marking the first row and col (dc components) so the largest
   // square array we can use is 2 less than the min dimension
@@ -94,6 +102,29 @@ int largestPrimeFor(cv::Mat& imgMat) {
   return maxP;
 }
 
+namespace {
+
+// the largest size no bigger than n with no prime factor above 5
+int smoothSizeBelow(int n) {
+  int size = n;
+  while (size > 1 && cv::getOptimalDFTSize(size) != size) size--;
+  return size;
+}
+
+}  // namespace
+
+bool regionFor(const std::string& mode, int rows, int cols, cv::Rect& region) {
+  if (mode == "full") {
+    region = cv::Rect(0, 0, cols, rows);
+    return true;
+  }
+  if (mode != "smooth") return false;
+
+  int height = smoothSizeBelow(rows), width = smoothSizeBelow(cols);
+  region = cv::Rect((cols - width) / 2, (rows - height) / 2, width, height);
+  return true;
+}
+
 // find the shift of the array that was used for the watermark (ie. the peak)
 // and the PSNR of the correlations
 void findShiftAndPSNR(double* correlation_vals, int array_len, double& peak2rms, int& peak_pos) {
@@ -149,6 +180,46 @@ void unscramble(double* array, int array_len, int key) {
   }
 }
 
+// read the non-blank lines of a json lines manifest
+bool readManifest(const std::string& manifestPath, std::vector<std::string>& records) {
+  std::ifstream manifest(manifestPath.c_str());
+  if (!manifest) {
+    std::cout << "unable to read manifest " << manifestPath << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (line.find_first_not_of(" \t\r") != std::string::npos) records.push_back(line);
+  }
+  return true;
+}
+
+bool parseNumber(const std::string& text, int& number) {
+  char* end;
+  errno = 0;
+  long value = strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || errno != 0 || value < INT_MIN || value > INT_MAX) {
+    return false;
+  }
+  number = (int)value;
+  return true;
+}
+
+bool parseNumber(const std::string& text, double& number) {
+  char* end;
+  errno = 0;
+  double value = strtod(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || errno != 0 || !std::isfinite(value)) return false;
+  number = value;
+  return true;
+}
+
+int invalidOption(const std::string& option, const std::string& value) {
+  std::cout << "invalid value for " << option << ": " << value << std::endl;
+  return -1;
+}
+
 // write out a json file with the message and confidence to the specified path
 int outputResultsFile(std::string message, double confidence, std::string filePath) {
   nlohmann::json j;
@@ -173,18 +244,46 @@ int outputResultsFileExtended(const DetectionStats& stats, std::string filePath)
   // Image properties
   j["imageWidth"] = stats.imageWidth;
   j["imageHeight"] = stats.imageHeight;
+  j["region"]["mode"] = stats.regionMode;
+  j["region"]["x"] = stats.region.x;
+  j["region"]["y"] = stats.region.y;
+  j["region"]["width"] = stats.region.width;
+  j["region"]["height"] = stats.region.height;
   j["primeSize"] = stats.primeSize;
 
   // Detection status
   j["detected"] = stats.detected;
   j["threshold"] = stats.threshold;
+  if (stats.fpRate > 0) j["fpRate"] = stats.fpRate;
+  j["falsePositive"] = std::pow(10.0, stats.log10FalsePositive);
+  j["falsePositiveLog10"] = stats.log10FalsePositive;
+  j["precision"] = stats.precision;
+  j["framing"] = stats.framing;
+  j["frameValid"] = stats.frameValid;
+  j["blind"] = stats.blind;
 
   // Timing breakdown (milliseconds)
   j["timing"]["imageLoad"] = stats.timeImageLoad;
+  j["timing"]["registration"] = stats.timeRegistration;
   j["timing"]["extraction"] = stats.timeExtraction;
   j["timing"]["correlation"] = stats.timeCorrelation;
   j["timing"]["total"] = stats.timeTotal;
 
+  // Registration of the marked image to the original
+  if (stats.registered) {
+    const RegistrationStats& reg = stats.registration;
+    j["registration"]["applied"] = reg.applied;
+    j["registration"]["angle"] = reg.angle;
+    j["registration"]["scale"] = reg.scale;
+    j["registration"]["shiftX"] = reg.shiftX;
+    j["registration"]["shiftY"] = reg.shiftY;
+    j["registration"]["response"] = reg.response;
+    j["registration"]["timing"]["pyramid"] = reg.timePyramid;
+    j["registration"]["timing"]["rotationScale"] = reg.timeRotationScale;
+    j["registration"]["timing"]["translation"] = reg.timeTranslation;
+    j["registration"]["timing"]["warp"] = reg.timeWarp;
+  }
+
   // Sequence statistics
   j["totalSequencesTested"] = stats.totalSequencesTested;
   j["sequencesAboveThreshold"] = stats.sequencesAboveThreshold;
@@ -205,6 +304,7 @@ int outputResultsFileExtended(const DetectionStats& stats, std::string filePath)
     seqJson["peakVal"] = seq.peakVal;
     seqJson["rms"] = seq.rms;
     seqJson["shift"] = seq.shift;
+    seqJson["pValue"] = std::pow(10.0, seq.log10PValue);
     sequencesArray.push_back(seqJson);
   }
   j["sequences"] = sequencesArray;
@@ -22,6 +22,23 @@ struct SequenceStats {
   double peakVal;  // Raw peak correlation value
   double rms;      // RMS of all correlation values
   int shift;       // Detected shift value (peakY * p + peakX)
+  double log10PValue;  // log10 of the peak's false positive probability
+};
+
+// Alignment of the marked image to the original before subtraction
+struct RegistrationStats {
+  bool applied;     // whether the marked image was warped
+  double angle;     // rotation of the marked image, degrees counter-clockwise
+  double scale;     // scale of the marked image relative to the original
+  double shiftX;    // translation once rotated and scaled about the centre
+  double shiftY;
+  double response;  // phase correlation peak of the last translation estimate
+
+  // Timing of each phase (in milliseconds)
+  double timePyramid;
+  double timeRotationScale;
+  double timeTranslation;
+  double timeWarp;
 };
 
 // Structure to hold all detection statistics
@@ -33,6 +50,8 @@ struct DetectionStats {
   // Image properties
   int imageWidth;
   int imageHeight;
+  std::string regionMode;  // "full" or "smooth", see regionFor
+  cv::Rect region;         // the part of the image the mark was extracted from
   int primeSize;  // p value used for watermark arrays
 
   // Per-sequence statistics
@@ -41,6 +60,7 @@ struct DetectionStats {
 
   // Timing information (in milliseconds)
   double timeImageLoad;
+  double timeRegistration;
   double timeExtraction;
   double timeCorrelation;
   double timeTotal;
@@ -51,8 +71,32 @@ struct DetectionStats {
   double correlationMean;
   double correlationStdDev;
 
-  // Threshold used for detection
+  // Threshold used for detection, derived from the target false positive
+  // rate when one is set (fpRate > 0)
   double threshold;
+  double fpRate;
+
+  // log10 of the probability that an unmarked image gives families as strong
+  // as those the message was read from (the strongest family tested when no
+  // message was found)
+  double log10FalsePositive;
+
+  // Precision the transforms were computed in ("double" or "float")
+  std::string precision;
+
+  // Message framing found ("framed", "legacy", or "none" when only framed
+  // messages were looked for), and whether a framed message's checksum matched
+  // its digits
+  std::string framing;
+  bool frameValid;
+
+  // Whether the mark was extracted from the marked image alone, without an
+  // original to subtract
+  bool blind;
+
+  // Alignment of the marked image, when it was registered
+  bool registered;
+  RegistrationStats registration;
 
   // Success metrics
   bool detected;
@@ -64,10 +108,29 @@ struct DetectionStats {
 std::string ocv_type2str(int type);
 void saveImageToFile(std::string file_name, cv::Mat& imageMat);
 int largestPrimeFor(cv::Mat& imgMat);
+int largestPrimeFor(int rows, int cols);
+
+// the region an image is marked in, "full" for the whole image or "smooth" for
+// the centred region whose sides are the largest sizes no bigger than the
+// image's that the transforms handle fastest (products of 2, 3 and 5), so the
+// time to mark doesn't swing with the factors of the image's own size.
+// Returns false for any other mode.
+bool regionFor(const std::string& mode, int rows, int cols, cv::Rect& region);
 void findShiftAndPSNR(double* array, int array_len, double& peak2rms, int& shift);
 void scramble(double* array, int array_len, int key);
 void unscramble(double* array, int array_len, int key);
 
+// read the non-blank lines of a json lines manifest
+bool readManifest(const std::string& manifestPath, std::vector<std::string>& records);
+
+// parse the whole of text as a number, false if it isn't one (where atoi and
+// atof would quietly read garbage as 0)
+bool parseNumber(const std::string& text, int& number);
+bool parseNumber(const std::string& text, double& number);
+
+// print which option was given a value it can't use, returns -1 (for main)
+int invalidOption(const std::string& option, const std::string& value);
+
 // Legacy function for backward compatibility
 int outputResultsFile(std::string message, double confidence, std::string filePath);
 
@@ -1,32 +1,22 @@
-
-#include <boost/multiprecision/cpp_int.hpp>
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cmath>
+
+#include "FftBackend.hpp"
+#include "LegendreArray.hpp"
+#include "MarkCorrelator.hpp"
+#include "MessageCodec.hpp"
+#include "WatermarkDetection.hpp"
 
 using namespace std;
 using namespace cv;
 
 // p is any prime, k is a constant that defines the family of arrays produced by
 // shifts array is assumed to be packed into 1d, in row major order
-void generateArray(int p, int k, double* array) {
-  int i, j, shift;
-  int* legendre = new int[p];
-
-  // set all values to -1
-  for (i = 0; i < p; i++) {
-    legendre[i] = -1;
-  }
-  // set all values where index is a square (mod p) to 1
-  for (i = 0; i < p; i++) {
-    j = (i * i) % p;
-    legendre[j] = 1;
-  }
-  // shift the legendre sequence to make up each column
-  for (i = 0; i < p; i++) {
-    shift = (i * i * k) % p;
-    for (j = 0; j < p; j++) {
-      array[j * p + i] = legendre[(j + shift) % p];
-    }
-  }
+template <typename T>
+void generateArray(int p, int k, T* array) {
+  LegendreArray(p, k).materialize(array);
 }
 
 // p is any prime, k is a constant that defines the family of arrays produced by
@@ -66,7 +56,8 @@ void generateArray2(int p, int k, double* array) {
 // takes 2d array in the form of a 1d array in row major order
 // applies right shift, then downward shift
 //  - right shift = message % array_width, down shift = message / array_width
-void shiftIntoNewArray(double* array, double* shifted_array, int array_height, int array_width,
+template <typename T>
+void shiftIntoNewArray(T* array, T* shifted_array, int array_height, int array_width,
                        int message_num) {
   int v_shift, h_shift;
   v_shift = (message_num / array_width) % array_height;
@@ -82,136 +73,182 @@ void shiftIntoNewArray(double* array, double* shifted_array, int array_height, i
   }
 }
 
-int fastCorrelation(int height, int width, double* matrix1, double* matrix2,
-                    double* correlation_vals) {
-  // TODO - need to check array sizes are the same, return -1 if not
-  // TODO - this function could be sped up using the packed format for the
-  // complex output
-  //      - (see
-  //      http://docs.opencv.org/modules/core/doc/operations_on_arrays.html#dft)
-  //      - this would require coding the complex multiplication and complex
-  //      conjugate
-
-  int i, j;
-  Mat mat1 = Mat(height, width, DataType<double>::type, matrix1);
-  Mat mat2 = Mat(height, width, DataType<double>::type, matrix2);
-
-  mat1.convertTo(mat1, CV_32F);
-  mat2.convertTo(mat2, CV_32F);
-
-  cv::Mat mat3;
-
-  // Note: the matrix is not padded in this case, as padding to increase speed
-  // alters the result of the cross-correlation
-
-  Mat planes1[] = {Mat_<float>(mat1), Mat::zeros(mat1.size(), CV_32F)};
-  Mat planes2[] = {Mat_<float>(mat2), Mat::zeros(mat2.size(), CV_32F)};
-  Mat complexI1, complexI2;
-
-  merge(planes1, 2, complexI1);  // Add to the expanded another plane with zeros
-  merge(planes2, 2,
-        complexI2);  // this way the result may fit in the source matrix
-
-  dft(mat1, complexI1, DFT_COMPLEX_OUTPUT, mat1.rows);
-  dft(mat2, complexI2, DFT_COMPLEX_OUTPUT, mat2.rows);
-
-  split(complexI1, planes1);  // planes[0] = Re(DFT(I), planes[1] = Im(DFT(I))
-  split(complexI2, planes2);
-
-  complex<float> z1, z2, z3;
-
-  for (i = 0; i < mat1.rows; i++) {
-    for (j = 0; j < mat1.cols; j++) {
-      z1 = complex<float>(planes1[0].at<float>(i, j), planes1[1].at<float>(i, j));
-      z2 = complex<float>(planes2[0].at<float>(i, j), planes2[1].at<float>(i, j));
-      z3 = z1 * std::conj(z2);
-
-      // put the result back in
-      planes1[0].at<float>(i, j) = z3.real();
-      planes1[1].at<float>(i, j) = z3.imag();
-    }
+template void generateArray<float>(int, int, float*);
+template void generateArray<double>(int, int, double*);
+template void shiftIntoNewArray<float>(float*, float*, int, int, int);
+template void shiftIntoNewArray<double>(double*, double*, int, int, int);
+
+// sums the shifted watermark arrays for every message digit into one array, so
+// the whole message can be embedded with a single insertMark call
+// - family k = digit index + 1, each family is multiplied by strength and shifted
+//   by its message digit exactly as in shiftIntoNewArray
+// - the transform is linear so this matches one insertMark call per digit up to
+//   floating point rounding: marked luma values agree to within 1e-9 (normalised
+//   to [0,1]), so 8-bit output pixels are identical except where a value lands
+//   within that distance of a rounding boundary, where they differ by at most 1
+// - framed messages also add the header family
+void combineMarks(int p, std::vector<int> shifts, double strength, double* combinedMark,
+                  bool framed) {
+  int i, j, k;
+
+  for (i = 0; i < p * p; i++) {
+    combinedMark[i] = 0.0;
   }
 
-  merge(planes1, 2, complexI1);
-
-  // calculating the idft
-  Mat inverseTransform;
-  dft(complexI1, inverseTransform, DFT_INVERSE | DFT_REAL_OUTPUT | DFT_SCALE);
-
-  for (i = 0; i < height; i++) {
-    for (j = 0; j < width; j++) {
-      correlation_vals[i * width + j] = inverseTransform.at<float>(i, j);
+  int families = (int)shifts.size() + (framed ? 1 : 0);
+  for (k = 1; k <= families; k++) {
+    LegendreArray wm = k <= (int)shifts.size()
+                           ? LegendreArray(p, k, strength, shifts[k - 1])
+                           : LegendreArray(p, frameHeaderFamily(p), strength, frameHeader(p, shifts));
+    for (i = 0; i < p; i++) {
+      for (j = 0; j < p; j++) {
+        combinedMark[i * p + j] += wm(i, j);
+      }
     }
   }
+}
+
+// T is the precision the transforms are computed in (float or double), the
+// spectra are multiplied in the same precision
+// - to correlate one array with many others, keep a MarkCorrelator so the
+//   first array is only transformed once
+template <typename T>
+int fastCorrelation(int height, int width, T* matrix1, T* matrix2, T* correlation_vals) {
+  // TODO - need to check array sizes are the same, return -1 if not
+  MarkCorrelator<T> correlator(height, width, matrix1);
+  correlator.correlate(matrix2, correlation_vals);
 
   return 1;
 }
 
 // convert to freqency domain and extract watermark data from the top-left
 // square of the image data
-int extractMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-                double* pixelsArray, double* extracted_mark) {
-  int i, j;
-  Mat mat = Mat(pixelsHeight, pixelsWidth, cv::DataType<double>::type, pixelsArray);
-
-  cv::dft(mat, mat, cv::DFT_REAL_OUTPUT, mat.rows);
+// - only that block is read, so backends that can prune the transform compute
+//   just its coefficients, and pixels is left unspecified
+template <typename T>
+int extractMark(const LumaView<T>& pixels, const LumaView<T>& extracted) {
+  Mat mat = pixels.mat();
+  Mat block = extracted.mat();
 
-  for (i = 0; i < watermarkHeight; i++)
-    for (j = 0; j < watermarkWidth; j++)
-      extracted_mark[i * watermarkWidth + j] = mat.at<double>(i + 1, j + 1);
+  realDftBlock(mat, block);
 
   return 1;
 }
 
-int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-               double* pixelsArray, double* watermarkArray) {
-  int i, j;
-  Mat mat = cv::Mat(pixelsHeight, pixelsWidth, cv::DataType<double>::type, pixelsArray);
-
-  cv::dft(mat, mat, cv::DFT_REAL_OUTPUT, mat.rows);
-
-  for (i = 0; i < watermarkHeight; i++)
-    for (j = 0; j < watermarkWidth; j++)
-      mat.at<double>(i + 1, j + 1) += watermarkArray[i * watermarkWidth + j];
+template <typename T>
+int extractMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
+                T* pixelsArray, T* extracted_mark) {
+  return extractMark(LumaView<T>(pixelsArray, pixelsHeight, pixelsWidth),
+                     LumaView<T>(extracted_mark, watermarkHeight, watermarkWidth));
+}
 
-  cv::dft(mat, mat, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+template <typename T>
+void whitenMark(int p, T* extracted_mark, int radius) {
+  Mat mark = Mat(p, p, cv::DataType<T>::type, extracted_mark);
+  Mat energy;
+  cv::multiply(mark, mark, energy);
+  cv::blur(energy, energy, cv::Size(2 * radius + 1, 2 * radius + 1), cv::Point(-1, -1),
+           cv::BORDER_REFLECT);
+
+  for (int i = 0; i < p; i++) {
+    const T* localEnergy = energy.ptr<T>(i);
+    for (int j = 0; j < p; j++) {
+      T rms = std::sqrt(localEnergy[j]);
+      extracted_mark[i * p + j] = rms > 0 ? extracted_mark[i * p + j] / rms : 0;
+    }
+  }
+}
 
-  for (i = 0; i < mat.rows; i++)
-    for (j = 0; j < mat.cols; j++)
-      pixelsArray[i * mat.cols + j] = mat.at<double>(i, j);
+namespace {
 
-  return 1;
-}
+// transform pixels, add coefficient(i, j) to the spectrum at (i + 1, j + 1)
+// for the (height x width) block, and transform back, all where the pixels
+// are (the backends transform a cv::Mat header on them in place)
+template <typename T, typename Coefficient>
+void markSpectrum(const LumaView<T>& pixels, int height, int width, const Coefficient& coefficient,
+                  bool progress) {
+  Mat mat = pixels.mat();
 
-// Note: original watermark remains unshifted, ie. no side effects
-int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-               double* pixelsArray, double* watermarkArray, int message_num) {
-  int i, j;
+  if (progress) std::cout << "PROGRESS:dft" << std::endl;
+  realDft(mat);
 
-  double* shifted_mark = new double[watermarkHeight * watermarkWidth];
-  shiftIntoNewArray(watermarkArray, shifted_mark, watermarkHeight, watermarkWidth, message_num);
+  for (int i = 0; i < height; i++) {
+    T* row = pixels.row(i + 1) + 1;
+    for (int j = 0; j < width; j++) row[j] += (T)coefficient(i, j);
+  }
 
-  Mat mat = cv::Mat(pixelsHeight, pixelsWidth, cv::DataType<double>::type, pixelsArray);
+  if (progress) std::cout << "PROGRESS:idft" << std::endl;
+  realDft(mat, true);
+}
 
-  std::cout << "PROGRESS:dft" << std::endl;
-  cv::dft(mat, mat, cv::DFT_REAL_OUTPUT, mat.rows);
+}  // namespace
 
-  for (i = 0; i < watermarkHeight; i++)
-    for (j = 0; j < watermarkWidth; j++)
-      mat.at<double>(i + 1, j + 1) += shifted_mark[i * watermarkWidth + j];
+// the array lands where shiftIntoNewArray would move it, read in place rather
+// than shifted into a copy
+// Note: original watermark remains unshifted, ie. no side effects
+template <typename T>
+int insertMark(const LumaView<T>& pixels, const T* watermarkArray, int watermarkHeight,
+               int watermarkWidth, int message_num, bool progress) {
+  int v_shift = (message_num / watermarkWidth) % watermarkHeight;
+  int h_shift = message_num % watermarkWidth;
+  markSpectrum(pixels, watermarkHeight, watermarkWidth,
+               [&](int i, int j) {
+                 int k = (i - v_shift + watermarkHeight) % watermarkHeight;
+                 int l = (j - h_shift + watermarkWidth) % watermarkWidth;
+                 return watermarkArray[k * watermarkWidth + l];
+               },
+               progress);
+  return 1;
+}
 
-  std::cout << "PROGRESS:idft" << std::endl;
-  cv::dft(mat, mat, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+// add the watermark array to the spectrum without materialising it, the array
+// carries its own strength and message shift
+template <typename T>
+int insertMark(const LumaView<T>& pixels, const LegendreArray& watermark) {
+  markSpectrum(pixels, watermark.size(), watermark.size(),
+               [&](int i, int j) { return watermark(i, j); }, true);
+  return 1;
+}
 
-  for (i = 0; i < mat.rows; i++)
-    for (j = 0; j < mat.cols; j++)
-      pixelsArray[i * mat.cols + j] = mat.at<double>(i, j);
+template <typename T>
+int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
+               T* pixelsArray, T* watermarkArray) {
+  return insertMark(LumaView<T>(pixelsArray, pixelsHeight, pixelsWidth), watermarkArray,
+                    watermarkHeight, watermarkWidth, 0, false);
+}
 
-  delete[] shifted_mark;
+template <typename T>
+int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
+               T* pixelsArray, T* watermarkArray, int message_num) {
+  return insertMark(LumaView<T>(pixelsArray, pixelsHeight, pixelsWidth), watermarkArray,
+                    watermarkHeight, watermarkWidth, message_num, true);
+}
 
-  return 1;
+template <typename T>
+int insertMark(int pixelsHeight, int pixelsWidth, T* pixelsArray, const LegendreArray& watermark) {
+  return insertMark(LumaView<T>(pixelsArray, pixelsHeight, pixelsWidth), watermark);
 }
 
+// the transforms are only built for single and double precision
+template int fastCorrelation<float>(int, int, float*, float*, float*);
+template int fastCorrelation<double>(int, int, double*, double*, double*);
+template int extractMark<float>(const LumaView<float>&, const LumaView<float>&);
+template int extractMark<double>(const LumaView<double>&, const LumaView<double>&);
+template int extractMark<float>(int, int, int, int, float*, float*);
+template int extractMark<double>(int, int, int, int, double*, double*);
+template void whitenMark<float>(int, float*, int);
+template void whitenMark<double>(int, double*, int);
+template int insertMark<float>(int, int, int, int, float*, float*);
+template int insertMark<double>(int, int, int, int, double*, double*);
+template int insertMark<float>(int, int, int, int, float*, float*, int);
+template int insertMark<double>(int, int, int, int, double*, double*, int);
+template int insertMark<float>(int, int, float*, const LegendreArray&);
+template int insertMark<double>(int, int, double*, const LegendreArray&);
+template int insertMark<float>(const LumaView<float>&, const float*, int, int, int, bool);
+template int insertMark<double>(const LumaView<double>&, const double*, int, int, int, bool);
+template int insertMark<float>(const LumaView<float>&, const LegendreArray&);
+template int insertMark<double>(const LumaView<double>&, const LegendreArray&);
+
 // subtract the original object image from the extracted object image and put
 // the result into a 1d array
 void extractMarkedImageDataWithSubtraction(Mat& extracted_obj_img, Mat& obj_img,
@@ -246,117 +283,29 @@ double peak2rms(double* array, int array_len) {
   return maxVal / sqrt(ms);
 }
 
+// the message codec does the conversion, in O(n^2) for n digits
 std::vector<int> getShifts(std::string ascii, int arraySize) {
-  vector<int> bits;
-  vector<int> shifts;
-
-  //    // print the input
-  //    std::cout << "Message is: " << ascii << std::endl;
-  //    std::cout << "Message consists of " << (ascii.length()*7) << " bits." <<
-  //    std::endl;
-
-  // convert ASCII to an array of bits (base 2)
-  unsigned char c;
-  for (unsigned char_num = 0; char_num < ascii.length(); char_num++) {
-    c = ascii.at(char_num);
-    for (int shift = 6; shift >= 0; shift--) {
-      bits.push_back(c >> shift & 1);
-    }
-  }
-
-  //    // print the array of bits
-  //    std::cout << "bitsArray: ";
-  //    std::copy(bits.begin(), bits.end(),
-  //    std::ostream_iterator<int>(std::cout, " ")); std::cout << std::endl;
-
-  // convert array of bits (base 2) to base 10
-  boost::multiprecision::cpp_int big_int_total = bits.front();
-  boost::multiprecision::cpp_int big_int_num;
-  for (int bit_num = 1; bit_num < bits.size(); bit_num++) {
-    big_int_num = 2;
-    int bit = bits.at(bit_num);
-    if (bit == 1) {
-      for (int i = 1; i < bit_num; i++) {
-        big_int_num *= 2;
-      }
-      big_int_total += big_int_num;
-    }
-  }
-
-  // convert base 10 to shifts (base arraySize)
-  boost::multiprecision::cpp_int n = big_int_total;
-  boost::multiprecision::cpp_int z;
-  while (n > 0) {
-    z = n % arraySize;
-    int messageDigit = z.template convert_to<int>();
-    shifts.push_back(messageDigit);
-    n = n / arraySize;
-  }
-
-  //    // print the output
-  //    std::cout << "shiftDigitsArray: ";
-  //    std::copy(shifts.begin(), shifts.end(),
-  //    std::ostream_iterator<int>(std::cout, " ")); std::cout  << std::endl;
-
-  return shifts;
+  return encodeMessage(ascii, arraySize);
 }
 
-std::string getASCII(std::vector<int> shifts, int arraySize) {
-  boost::multiprecision::cpp_int n, z;
-
-  // print input
-  std::cout << "shiftDigitsArray: ";
-  std::copy(shifts.begin(), shifts.end(), std::ostream_iterator<int>(std::cout, " "));
-  std::cout << std::endl;
-
-  // convert base array-size to base 10 (store in n)
-  std::vector<int> bits;
-  n = shifts.front();
-  for (int shiftDigitNum = 1; shiftDigitNum < shifts.size(); shiftDigitNum++) {
-    z = shifts.at(shiftDigitNum);
-    for (int i = 0; i < shiftDigitNum; i++) {
-      z *= arraySize;
-    }
-    n += z;
-  }
+int frameHeaderFamily(int p) {
+  return p - 1;
+}
 
-  // convert base 10 to base 2 and store as an array of bits
-  while (n > 0) {
-    z = n % 2;
-    bits.push_back(z.template convert_to<int>());
-    n = n / 2;
-  }
+// the message families must not reach the header family
+int frameHeader(int p, const std::vector<int>& shifts) {
+  CV_Assert((int)shifts.size() < frameHeaderFamily(p));
 
-  // add any trailing zeros that were lost in the conversion
-  unsigned long numMissingBits = bits.size() / 7;
-  while (numMissingBits > 0) {
-    bits.push_back(0);
-    numMissingBits--;
-  }
+  long long checksum = 0;
+  for (size_t i = 0; i < shifts.size(); i++) checksum = (checksum * 131 + shifts[i] + 1) % p;
 
-  // print the bits array
-  std::cout << "bitsArray: ";
-  std::copy(bits.begin(), bits.end(), std::ostream_iterator<int>(std::cout, " "));
-  std::cout << std::endl;
-
-  // convert the array of bits to ASCII
-  int char_count = 0, bit;
-  unsigned char char_sum = 0;
-  std::string messageStr;
-  while (bits.size() > 0) {
-    bit = bits.front();
-    char_sum += bit * pow(2, 6 - char_count);
-    bits.erase(bits.begin());  // remove first element
-    char_count++;
-    char_count %= 7;
-    if (char_count == 0) {
-      messageStr.append(1, char_sum);
-      char_sum = 0;
-    }
-  }
+  return (int)shifts.size() + p * (int)checksum;
+}
 
-  // print the output
-  std::cout << "Message is: " << messageStr << std::endl;
+int frameDigitCount(int p, int header) {
+  return header % p;
+}
 
-  return messageStr;
+std::string getASCII(std::vector<int> shifts, int arraySize) {
+  return decodeMessage(shifts, arraySize);
 }
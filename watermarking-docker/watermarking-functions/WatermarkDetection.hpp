@@ -6,17 +6,51 @@
 #include <string>
 #include <vector>
 
-void generateArray(int p, int k, double* array);
+#include "LegendreArray.hpp"
+#include "LumaView.hpp"
+
+// The array and transform functions are built for T = float and T = double.
+// double is the default precision, float halves the memory of every transform
+// and runs faster at the cost of rounding error far below 8-bit quantisation.
+template <typename T>
+void generateArray(int p, int k, T* array);
 void generateArray2(int p, int k, double* array);
+// The embedding and extraction transform the caller's pixels in place, with
+// no copies and no allocations of their own (the native backend's scratch is
+// kept per thread), the pointer forms view contiguous arrays.
+// insertMark adds the watermark array, shifted by message_num as
+// shiftIntoNewArray shifts it, at (1, 1) of the pixels' CCS packed spectrum,
+// printing progress lines around the transforms when progress is set.
+template <typename T>
+int insertMark(const LumaView<T>& pixels, const T* watermarkArray, int watermarkHeight,
+               int watermarkWidth, int message_num = 0, bool progress = false);
+template <typename T>
+int insertMark(const LumaView<T>& pixels, const LegendreArray& watermark);
+template <typename T>
+int extractMark(const LumaView<T>& pixels, const LumaView<T>& extracted);
+template <typename T>
 int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-               double* pixelsArray, double* watermarkArray);
+               T* pixelsArray, T* watermarkArray);
+template <typename T>
 int insertMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-               double* pixelsArray, double* watermarkArray, int message_num);
+               T* pixelsArray, T* watermarkArray, int message_num);
+template <typename T>
+int insertMark(int pixelsHeight, int pixelsWidth, T* pixelsArray, const LegendreArray& watermark);
+template <typename T>
 int extractMark(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
-                double* pixelsArray, double* extracted_mark);
-int fastCorrelation(int height, int width, double* matrix1, double* matrix2,
-                    double* correlation_vals);
-void shiftIntoNewArray(double* array, double* shifted_array, int array_height, int array_width,
+                T* pixelsArray, T* extracted_mark);
+// Blind detection (no original to subtract): divide each extracted coefficient
+// by the RMS of its (2 radius + 1)^2 neighbourhood, so the host image's
+// coefficients, large at low frequencies, are evened out to unit variance
+// while the mark's sign pattern is kept
+template <typename T>
+void whitenMark(int p, T* extracted_mark, int radius);
+void combineMarks(int p, std::vector<int> shifts, double strength, double* combinedMark,
+                  bool framed = false);
+template <typename T>
+int fastCorrelation(int height, int width, T* matrix1, T* matrix2, T* correlation_vals);
+template <typename T>
+void shiftIntoNewArray(T* array, T* shifted_array, int array_height, int array_width,
                        int message_num);
 
 void extractMarkedImageDataWithSubtraction(cv::Mat& extracted_obj_img, cv::Mat& obj_img,
@@ -24,6 +58,15 @@ void extractMarkedImageDataWithSubtraction(cv::Mat& extracted_obj_img, cv::Mat&
 
 double peak2rms(double* array, int array_len);
 std::vector<int> getShifts(std::string ascii, int arraySize);
+
+// Framed messages add a header family, k = p - 1, after the message families.
+// Its shift is the digit count plus p times a checksum of the digits, so a
+// detector knows how many families to read and can reject a corrupt decode.
+// Unframed (legacy) detectors still read framed messages, they never reach
+// the header family.
+int frameHeaderFamily(int p);
+int frameHeader(int p, const std::vector<int>& shifts);
+int frameDigitCount(int p, int header);
 std::string getASCII(std::vector<int> shifts, int arraySize);
 
 #endif /* WatermarkDetection_hpp */
\ No newline at end of file
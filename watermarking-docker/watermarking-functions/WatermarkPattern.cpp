@@ -0,0 +1,30 @@
+#include "WatermarkPattern.hpp"
+
+#include "FftBackend.hpp"
+
+WatermarkPattern::WatermarkPattern(int pixelsHeight, int pixelsWidth, int watermarkHeight,
+                                   int watermarkWidth, double* watermarkArray, int depth) {
+  CV_Assert(depth == CV_64F || depth == CV_32F);
+  cv::Mat mat = cv::Mat::zeros(pixelsHeight, pixelsWidth, depth);
+
+  // place the watermark where insertMark adds it to the spectrum of the image
+  cv::Mat block;
+  cv::Mat(watermarkHeight, watermarkWidth, CV_64F, watermarkArray).convertTo(block, depth);
+  block.copyTo(mat(cv::Rect(1, 1, watermarkWidth, watermarkHeight)));
+
+  realDft(mat, true);
+
+  // insertMark works on luma normalised to [0, 1], store the pattern in 8-bit
+  // units so it can be added straight to the value channel
+  mat.convertTo(pattern_, CV_32F, 255.0);
+}
+
+WatermarkPattern::WatermarkPattern(const cv::Mat& pattern, std::shared_ptr<void> owner)
+    : pattern_(pattern), owner_(owner) {}
+
+void WatermarkPattern::applyTo(cv::Mat& plane) const {
+  CV_Assert(plane.type() == CV_8U && plane.size() == pattern_.size());
+
+  // vectorised add with the result saturated back to 8 bits
+  cv::add(plane, pattern_, plane, cv::noArray(), CV_8U);
+}
@@ -0,0 +1,51 @@
+/* Header for WatermarkPattern */
+
+#ifndef WatermarkPattern_hpp
+#define WatermarkPattern_hpp
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+// The spatial domain form of a watermark.
+// Marking is linear (marked luma = luma + idft(watermark coefficients)), so the
+// pattern is computed once with a single inverse transform of the coefficient
+// block and can then be added to any image of the same size without a forward
+// transform.
+class WatermarkPattern {
+ public:
+  WatermarkPattern() {}
+
+  // watermarkArray is the (watermarkHeight x watermarkWidth) block of
+  // coefficients that insertMark adds at (1, 1) of the CCS packed spectrum,
+  // depth is the precision of the inverse transform (CV_64F or CV_32F)
+  WatermarkPattern(int pixelsHeight, int pixelsWidth, int watermarkHeight, int watermarkWidth,
+                   double* watermarkArray, int depth = CV_64F);
+
+  // wrap a pattern that has already been computed (CV_32F, 8-bit luma units),
+  // owner keeps any external memory behind the pattern (eg. a mapping) alive
+  explicit WatermarkPattern(const cv::Mat& pattern,
+                            std::shared_ptr<void> owner = std::shared_ptr<void>());
+
+  int rows() const {
+    return pattern_.rows;
+  }
+  int cols() const {
+    return pattern_.cols;
+  }
+  bool empty() const {
+    return pattern_.empty();
+  }
+  const cv::Mat& mat() const {
+    return pattern_;
+  }
+
+  // add the pattern to an 8-bit (CV_8U) plane of the same size, rounding and
+  // saturating the result to [0, 255]
+  void applyTo(cv::Mat& plane) const;
+
+ private:
+  cv::Mat pattern_;
+  std::shared_ptr<void> owner_;
+};
+
+#endif /* WatermarkPattern_hpp */